@@ -1,11 +1,15 @@
 """
 Bridge to interact with C++ OSM building finder logic
-For MVP: calls C++ executable via subprocess
+Runs the C++ executable once in --server mode and keeps it alive, so the
+map is parsed a single time instead of on every HTTP request
 Future: Can be replaced with pybind11 bindings for better performance
 """
+import itertools
 import json
+import queue
 import subprocess
 import logging
+import threading
 from typing import Dict, List, Optional
 from pathlib import Path
 
@@ -13,47 +17,114 @@ logger = logging.getLogger(__name__)
 
 
 class CPPBridge:
-    def __init__(self, cpp_executable: str = "../json_api"):
+    def __init__(self, cpp_executable: str = "../json_api", timeout: float = 5,
+                 startup_timeout: float = 120):
         self.cpp_executable = Path(cpp_executable).resolve()
         if not self.cpp_executable.exists():
             logger.warning(f"C++ executable not found at {cpp_executable}")
+        self.timeout = timeout
+        # The server loads the map before it reads its first command, so
+        # the first reply after a start may take this long instead
+        self.startup_timeout = startup_timeout
+        self._process: Optional[subprocess.Popen] = None
+        self._replies: "queue.Queue[str]" = queue.Queue()
+        self._lock = threading.Lock()
+        self._ids = itertools.count(1)
+
+    def _start(self) -> subprocess.Popen:
+        """Start the C++ server process (from project root, where data/ is)"""
+        cwd = Path(__file__).parent.parent  # Go to project root
+        logger.info("Starting C++ server process")
+        process = subprocess.Popen(
+            [str(self.cpp_executable), "--server"],
+            stdin=subprocess.PIPE,
+            stdout=subprocess.PIPE,
+            stderr=subprocess.DEVNULL,
+            text=True,
+            bufsize=1,
+            cwd=str(cwd)
+        )
+
+        # Reader thread forwards stdout lines so calls can time out;
+        # an empty string marks end of output
+        self._replies = queue.Queue()
+        replies = self._replies
+
+        def read_replies():
+            for line in process.stdout:
+                replies.put(line)
+            replies.put("")
+
+        threading.Thread(target=read_replies, daemon=True).start()
+        return process
+
+    def _stop(self):
+        """Kill the C++ server process, e.g. after it stopped responding"""
+        if self._process is not None:
+            self._process.kill()
+            self._process.wait()
+            self._process = None
+
+    def close(self):
+        """Shut down the C++ server process"""
+        with self._lock:
+            if self._process is not None:
+                self._process.stdin.close()
+                try:
+                    self._process.wait(timeout=self.timeout)
+                except subprocess.TimeoutExpired:
+                    pass
+                self._stop()
 
     def _call_cpp(self, command: Dict) -> Optional[Dict]:
         """
-        Call C++ executable with JSON command via stdin
-        Returns parsed JSON response from stdout
+        Send a JSON command to the C++ server via stdin
+        Returns parsed JSON response read back from stdout
         """
-        try:
-            # Convert command to JSON string
-            input_json = json.dumps(command)
-
-            # Call C++ process from parent directory (where data/ folder is)
-            cwd = Path(__file__).parent.parent  # Go to project root
-            result = subprocess.run(
-                [str(self.cpp_executable)],
-                input=input_json,
-                capture_output=True,
-                text=True,
-                timeout=5,
-                cwd=str(cwd)
-            )
-
-            if result.returncode != 0:
-                logger.error(f"C++ process failed: {result.stderr}")
-                return None
+        with self._lock:
+            try:
+                started = self._process is None or self._process.poll() is not None
+                if started:
+                    self._process = self._start()
+
+                # Tag the command so the reply can be matched to it
+                request_id = next(self._ids)
+                self._process.stdin.write(json.dumps({**command, "id": request_id}) + "\n")
+                self._process.stdin.flush()
+
+                line = self._readline(self.startup_timeout if started else self.timeout)
+                if not line:
+                    logger.error("C++ process exited unexpectedly")
+                    self._stop()
+                    return None
+
+                response = json.loads(line)
+                if response.get("id") != request_id:
+                    logger.error("C++ process replied out of order")
+                    self._stop()
+                    return None
+
+                return response
 
-            # Parse JSON response
-            return json.loads(result.stdout)
+            except subprocess.TimeoutExpired:
+                logger.error("C++ process timed out")
+                self._stop()
+                return None
+            except json.JSONDecodeError as e:
+                logger.error(f"Failed to parse C++ JSON response: {e}")
+                self._stop()
+                return None
+            except Exception as e:
+                logger.error(f"Error calling C++ bridge: {e}")
+                self._stop()
+                return None
 
-        except subprocess.TimeoutExpired:
-            logger.error("C++ process timed out")
-            return None
-        except json.JSONDecodeError as e:
-            logger.error(f"Failed to parse C++ JSON response: {e}")
-            return None
-        except Exception as e:
-            logger.error(f"Error calling C++ bridge: {e}")
-            return None
+    def _readline(self, timeout: float) -> str:
+        """Read one response line, giving up after timeout seconds"""
+        try:
+            return self._replies.get(timeout=timeout)
+        except queue.Empty:
+            raise subprocess.TimeoutExpired(str(self.cpp_executable), timeout)
 
     def get_all_buildings(self) -> List[Dict]:
         """Get all buildings from OSM data"""
@@ -82,6 +153,31 @@ class CPPBridge:
             return response.get("building")
         return None
 
+    def find_buildings_at(self, lat: float, lon: float) -> List[Dict]:
+        """Find the buildings whose outline contains a location, smallest first"""
+        response = self._call_cpp({
+            "command": "building_at",
+            "lat": lat,
+            "lon": lon
+        })
+        if response and response.get("success"):
+            return response.get("buildings", [])
+        return []
+
+    def find_buildings_in_bbox(self, min_lat: float, min_lon: float,
+                               max_lat: float, max_lon: float) -> List[Dict]:
+        """Find the buildings whose bounding box intersects a box"""
+        response = self._call_cpp({
+            "command": "buildings_in_bbox",
+            "min_lat": min_lat,
+            "min_lon": min_lon,
+            "max_lat": max_lat,
+            "max_lon": max_lon
+        })
+        if response and response.get("success"):
+            return response.get("buildings", [])
+        return []
+
     def get_all_nodes(self) -> List[Dict]:
         """Get all OSM nodes (for map rendering)"""
         response = self._call_cpp({"command": "list_nodes"})
@@ -89,6 +185,19 @@ class CPPBridge:
             return response.get("nodes", [])
         return []
 
+    def get_stats(self) -> Dict:
+        """
+        Get the C++ backend's map sizes and node instrumentation counters:
+        nodes added, ID lookups and misses (counters are only kept when
+        json_api is built with STATS=1)
+        """
+        response = self._call_cpp({"command": "stats"})
+        if response and response.get("success"):
+            response.pop("success", None)
+            response.pop("id", None)
+            return response
+        return {}
+
     def find_nearest_stops(self, lat: float, lon: float) -> Dict:
         """
         Find nearest northbound and southbound bus stops
@@ -102,3 +211,55 @@ class CPPBridge:
         if response and response.get("success"):
             return response.get("stops", {})
         return {"northbound": None, "southbound": None}
+
+    def find_stops_near(self, lat: float, lon: float, k: int = 10,
+                        radius: Optional[float] = None,
+                        routes: Optional[List[str]] = None,
+                        directions: Optional[List[str]] = None) -> List[Dict]:
+        """
+        Find the k nearest bus stops within radius miles (any distance if
+        None), on any of the given routes and going any of the given
+        directions (any if None), nearest first
+        """
+        command = {
+            "command": "nearest_stops",
+            "lat": lat,
+            "lon": lon,
+            "k": k
+        }
+        if radius is not None:
+            command["radius"] = radius
+        if routes:
+            command["routes"] = routes
+        if directions:
+            command["directions"] = directions
+
+        response = self._call_cpp(command)
+        if response and response.get("success"):
+            return response.get("stops", [])
+        return []
+
+    def find_stops_near_batch(self, points: List[Dict], k: int = 10,
+                              radius: Optional[float] = None,
+                              routes: Optional[List[str]] = None,
+                              directions: Optional[List[str]] = None) -> List[List[Dict]]:
+        """
+        find_stops_near for each of the points ({"lat": .., "lon": ..}) in
+        one call; the lists of stops are in the order of the points
+        """
+        command = {
+            "command": "nearest_stops_batch",
+            "points": points,
+            "k": k
+        }
+        if radius is not None:
+            command["radius"] = radius
+        if routes:
+            command["routes"] = routes
+        if directions:
+            command["directions"] = directions
+
+        response = self._call_cpp(command)
+        if response and response.get("success"):
+            return response.get("results", [])
+        return []
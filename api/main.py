@@ -11,7 +11,7 @@ import logging
 from models import (
     Building, BusStop, LiveBus, Route,
     BusStopWithPredictions, BusPrediction,
-    NearestStopsResponse, BuildingDetailResponse
+    NearestStopsResponse, BuildingDetailResponse, StopsNearBatchRequest
 )
 from cta_service import CTAService
 from cpp_bridge import CPPBridge
@@ -58,6 +58,12 @@ async def startup_event():
     logger.info(f"Using {len(nu_routes)} routes near NU: {nu_routes}")
 
 
+@app.on_event("shutdown")
+async def shutdown_event():
+    """Stop the C++ server process"""
+    cpp_bridge.close()
+
+
 @app.get("/")
 async def root():
     """Health check endpoint"""
@@ -115,6 +121,31 @@ async def search_buildings(q: str = Query(..., min_length=1)):
     return buildings
 
 
+@app.get("/api/buildings/at", response_model=List[Building])
+async def get_buildings_at(
+    lat: float = Query(..., ge=-90, le=90),
+    lon: float = Query(..., ge=-180, le=180)
+):
+    """Find the buildings a location is inside, smallest first"""
+    buildings_data = cpp_bridge.find_buildings_at(lat, lon)
+    return [Building(**b) for b in buildings_data]
+
+
+@app.get("/api/buildings/in-bbox", response_model=List[Building])
+async def get_buildings_in_bbox(
+    min_lat: float = Query(..., ge=-90, le=90),
+    min_lon: float = Query(..., ge=-180, le=180),
+    max_lat: float = Query(..., ge=-90, le=90),
+    max_lon: float = Query(..., ge=-180, le=180)
+):
+    """Find the buildings whose bounding box intersects a box (e.g. the map viewport)"""
+    if min_lat > max_lat or min_lon > max_lon:
+        raise HTTPException(status_code=400, detail="min_lat/min_lon must not be greater than max_lat/max_lon")
+
+    buildings_data = cpp_bridge.find_buildings_in_bbox(min_lat, min_lon, max_lat, max_lon)
+    return [Building(**b) for b in buildings_data]
+
+
 @app.get("/api/buildings/{building_id}", response_model=BuildingDetailResponse)
 async def get_building_details(building_id: int):
     """Get building details with nearest bus stops"""
@@ -238,6 +269,35 @@ async def get_nearest_stops(
     return NearestStopsResponse(northbound=northbound, southbound=southbound)
 
 
+@app.get("/api/bus-stops/near", response_model=List[BusStop])
+async def get_stops_near(
+    lat: float = Query(..., ge=-90, le=90),
+    lon: float = Query(..., ge=-180, le=180),
+    k: int = Query(10, ge=1, le=100),
+    radius: Optional[float] = Query(None, ge=0, description="miles"),
+    routes: Optional[str] = Query(None, description="comma-separated, e.g. 201,206"),
+    directions: Optional[str] = Query(None, description="comma-separated, e.g. Northbound,Eastbound")
+):
+    """Find the k nearest stops to a location, optionally within a radius and on given routes/directions"""
+    route_list = [r.strip() for r in routes.split(',') if r.strip()] if routes else None
+    direction_list = [d.strip() for d in directions.split(',') if d.strip()] if directions else None
+
+    stops_data = cpp_bridge.find_stops_near(lat, lon, k, radius, route_list, direction_list)
+    return [BusStop(**stop) for stop in stops_data]
+
+
+@app.post("/api/bus-stops/near/batch", response_model=List[List[BusStop]])
+async def get_stops_near_batch(request: StopsNearBatchRequest):
+    """Find the k nearest stops to each of many locations at once, in the order given"""
+    if request.k < 1 or (request.radius is not None and request.radius < 0):
+        raise HTTPException(status_code=400, detail="k must be at least 1 and radius at least 0")
+
+    points = [{"lat": p.lat, "lon": p.lon} for p in request.points]
+    results = cpp_bridge.find_stops_near_batch(points, request.k, request.radius,
+                                               request.routes, request.directions)
+    return [[BusStop(**stop) for stop in stops] for stops in results]
+
+
 @app.get("/api/routes", response_model=List[Route])
 async def get_routes():
     """Get all CTA routes near Northwestern"""
@@ -321,6 +381,16 @@ async def get_route_geometry(route_id: str):
         raise HTTPException(status_code=500, detail=str(e))
 
 
+@app.get("/api/stats")
+async def get_stats():
+    """Get map sizes and instrumentation counters from the C++ backend"""
+    try:
+        return cpp_bridge.get_stats()
+    except Exception as e:
+        logger.error(f"Error getting stats: {e}")
+        raise HTTPException(status_code=500, detail=str(e))
+
+
 def _get_predictions_for_stop(stop_id: str) -> List[BusPrediction]:
     """Helper function to get predictions for a stop"""
     predictions_data = cta_service.get_predictions(stop_id)
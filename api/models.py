@@ -52,6 +52,19 @@ class Route(BaseModel):
     color: Optional[str] = None
 
 
+class Point(BaseModel):
+    lat: float
+    lon: float
+
+
+class StopsNearBatchRequest(BaseModel):
+    points: List[Point]
+    k: int = 10
+    radius: Optional[float] = None  # miles
+    routes: Optional[List[str]] = None
+    directions: Optional[List[str]] = None
+
+
 class NearestStopsResponse(BaseModel):
     northbound: Optional[BusStopWithPredictions] = None
     southbound: Optional[BusStopWithPredictions] = None
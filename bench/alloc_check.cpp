@@ -0,0 +1,169 @@
+/*alloc_check.cpp*/
+
+//
+// Allocation check for the JSON API's query commands.
+//
+// Counts heap allocations (by replacing the global operator new)
+// while handleCommand answers search_building and nearest_stops, and
+// checks that no query copies the dataset:
+//
+//   - a search matching nothing allocates the same few blocks (the
+//     empty response) however many buildings it looks at
+//   - a matching search allocates a bounded number of blocks per
+//     building returned
+//   - no allocation is as large as the buildings array, the bus stop
+//     array or any other whole-dataset array
+//
+// json_api.cpp is compiled in with its main renamed, so the check runs
+// the real command handlers against the real loaded map.
+//
+// Usage:
+//   make check-alloc
+//   ./alloc_check [map file]
+//
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <new>
+
+#define main jsonApiMain
+#include "json_api.cpp"
+#undef main
+
+using namespace std;
+
+
+//
+// counters, updated only while Counting:
+//
+static bool Counting = false;
+static size_t NumAllocations = 0;
+static size_t LargestAllocation = 0;
+
+void* operator new(size_t size)
+{
+  if (Counting)
+  {
+    NumAllocations++;
+    LargestAllocation = max(LargestAllocation, size);
+  }
+
+  void* p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr)
+  {
+    throw bad_alloc();
+  }
+
+  return p;
+}
+
+void operator delete(void* p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  free(p);
+}
+
+
+//
+// AllocationCount
+//
+// What one command allocated.
+//
+struct AllocationCount
+{
+  size_t NumAllocations;
+  size_t LargestAllocation;
+  size_t NumResults;
+};
+
+static AllocationCount countCommand(const string& command, const char* resultsKey)
+{
+  json parsed = json::parse(command);
+
+  NumAllocations = 0;
+  LargestAllocation = 0;
+
+  Counting = true;
+  json response = handleCommand(parsed);
+  Counting = false;
+
+  AllocationCount count;
+  count.NumAllocations = NumAllocations;
+  count.LargestAllocation = LargestAllocation;
+  count.NumResults = response[resultsKey].size();
+  return count;
+}
+
+
+int main(int argc, char* argv[])
+{
+  if (argc > 1)
+  {
+    osmFile = argv[1];
+  }
+
+  if (!loadData())
+  {
+    return 1;
+  }
+
+  size_t numBuildings = buildings.getMapBuildings().size();
+  size_t numStops = busStops->getMapStops().size();
+
+  //
+  // the smallest whole-dataset array a copy would allocate:
+  //
+  size_t smallestDataset = min(numBuildings * sizeof(Building), numStops * sizeof(BusStop));
+
+  cout << numBuildings << " buildings, " << numStops << " bus stops; a copy of either allocates "
+       << smallestDataset << "+ bytes" << endl << endl;
+
+  AllocationCount none = countCommand(R"({"command": "search_building", "query": "no such building"})", "buildings");
+  AllocationCount hall = countCommand(R"({"command": "search_building", "query": "hall"})", "buildings");
+  AllocationCount stops = countCommand(R"({"command": "nearest_stops", "lat": 42.0581, "lon": -87.6741})", "stops");
+
+  auto report = [](const char* name, const AllocationCount& c) {
+    cout << "  " << name << ": " << c.NumAllocations << " allocations, largest "
+         << c.LargestAllocation << " bytes, " << c.NumResults << " results" << endl;
+  };
+
+  report("search_building (no match)", none);
+  report("search_building \"hall\"", hall);
+  report("nearest_stops", stops);
+
+  double perMatch = hall.NumResults > 0
+    ? (double) (hall.NumAllocations - none.NumAllocations) / hall.NumResults : 0.0;
+
+  cout << endl << "  " << perMatch << " allocations per building returned" << endl << endl;
+
+  bool ok = true;
+
+  if (none.NumAllocations >= 16 || none.NumAllocations >= numBuildings)
+  {
+    cout << "**ERROR: a search matching nothing allocates per building" << endl;
+    ok = false;
+  }
+
+  if (hall.NumResults == 0 || perMatch > 32)
+  {
+    cout << "**ERROR: a matching search allocates too much per result" << endl;
+    ok = false;
+  }
+
+  for (const AllocationCount* c : { &none, &hall, &stops })
+  {
+    if (c->LargestAllocation >= smallestDataset)
+    {
+      cout << "**ERROR: a query made an allocation the size of a whole-dataset copy" << endl;
+      ok = false;
+    }
+  }
+
+  cout << (ok ? "no whole-dataset copies" : "**ERROR: checks failed") << endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,300 @@
+/*buildings_bench.cpp*/
+
+//
+// Microbenchmark for Buildings::findInBox and findContaining (see
+// src/buildingindex.h).
+//
+// Places synthetic buildings over Chicago, each a polygon of 4 to 8
+// corners (some of them with a smaller building in their courtyard,
+// to exercise nesting), and compares the indexed queries with a scan
+// over all buildings, on:
+//
+//   - time per query, as the number of buildings grows from a
+//     neighborhood to about the whole city
+//   - the buildings found: both must return the same buildings in
+//     the same order for every query
+//
+// It also checks that a copied and a moved collection keep their
+// index, finding the same buildings as the original.
+//
+// Usage:
+//   make bench-buildings
+//   ./buildings_bench [numQueries]
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#include "buildings.h"
+#include "nodes.h"
+
+using namespace std;
+
+
+//
+// findInBoxScan
+//
+// The buildings whose box intersects the query box, by a scan.
+//
+static vector<const Building*> findInBoxScan(const Buildings& buildings, const BoundingBox& box)
+{
+  vector<const Building*> found;
+
+  for (const Building& B : buildings.getMapBuildings())
+  {
+    const BuildingGeometry& g = B.getGeometry();
+
+    if (B.getNodeIDs().size() > 0 && BoundingBox{ g.MinLat, g.MinLon, g.MaxLat, g.MaxLon }.intersects(box))
+    {
+      found.push_back(&B);
+    }
+  }
+
+  return found;
+}
+
+//
+// findContainingScan
+//
+// The buildings containing the point, by a scan, smallest first.
+//
+static vector<const Building*> findContainingScan(const Buildings& buildings, const Nodes& nodes,
+                                                  double lat, double lon)
+{
+  vector<const Building*> found;
+
+  for (const Building& B : buildings.getMapBuildings())
+  {
+    if (B.contains(nodes, lat, lon))
+    {
+      found.push_back(&B);
+    }
+  }
+
+  stable_sort(found.begin(), found.end(), [](const Building* b1, const Building* b2) {
+    return b1->getGeometry().Area < b2->getGeometry().Area;
+  });
+  return found;
+}
+
+//
+// sameBuildings
+//
+// True if the two lists hold the same buildings (by ID) in the same
+// order, each list's pointing into its own collection.
+//
+static bool sameBuildings(const vector<const Building*>& found, const vector<const Building*>& expected,
+                          const Buildings& owner)
+{
+  ArrayView<Building> all = owner.getMapBuildings();
+
+  if (found.size() != expected.size())
+  {
+    return false;
+  }
+
+  for (size_t i = 0; i < found.size(); i++)
+  {
+    if (found[i] < &all[0] || found[i] >= &all[0] + all.size() || found[i]->getID() != expected[i]->getID())
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+//
+// addPolygon
+//
+// Adds a building whose outline has the given number of corners
+// around (lat, lon), radius degrees of latitude out, turned by angle.
+//
+static void addPolygon(Buildings& buildings, Nodes& nodes, long long& nextID,
+                       double lat, double lon, double radius, int corners, double angle)
+{
+  buildings.add(nextID, "Building " + to_string(nextID), "");
+  nextID++;
+
+  long long first = nextID;
+  double lonScale = 1.0 / cos(lat * M_PI / 180.0);
+
+  for (int c = 0; c < corners; c++)
+  {
+    double a = angle + 2.0 * M_PI * c / corners;
+    nodes.add(nextID, lat + radius * sin(a), lon + radius * lonScale * cos(a), false);
+    buildings.addNodeID(nextID);
+    nextID++;
+  }
+
+  buildings.addNodeID(first);  // closed
+}
+
+//
+// runBench
+//
+// Runs the comparison for one number of buildings. Returns false if
+// the index and the scan disagree on any query.
+//
+static bool runBench(size_t numBuildings, size_t numQueries)
+{
+  mt19937_64 rng(42);
+  uniform_real_distribution<double> lat(41.64, 42.07);
+  uniform_real_distribution<double> lon(-87.94, -87.52);
+  uniform_real_distribution<double> unit(0.0, 1.0);
+
+  Nodes nodes;
+  Buildings buildings;
+  long long nextID = 1;
+
+  while ((size_t) buildings.getNumMapBuildings() < numBuildings)
+  {
+    double centerLat = lat(rng), centerLon = lon(rng);
+    double radius = 0.0002 + 0.0004 * unit(rng);  // about 20 to 70 m
+    int corners = 4 + (int) (rng() % 5);
+
+    addPolygon(buildings, nodes, nextID, centerLat, centerLon, radius, corners, 2.0 * M_PI * unit(rng));
+
+    if (rng() % 10 == 0)
+    {
+      addPolygon(buildings, nodes, nextID, centerLat, centerLon, radius / 3, 4, 0.0);  // in the courtyard
+    }
+  }
+
+  nodes.ensureOrder(1);
+
+  auto start = chrono::steady_clock::now();
+  buildings.resolveNodes(nodes, 1);
+  chrono::duration<double, milli> resolveTime = chrono::steady_clock::now() - start;
+
+  //
+  // points around the area, some of them at a building's center; and
+  // boxes of up to about a kilometer on a side:
+  //
+  ArrayView<Building> all = buildings.getMapBuildings();
+  vector<pair<double, double>> points(numQueries);
+  vector<BoundingBox> boxes(numQueries);
+
+  for (size_t i = 0; i < numQueries; i++)
+  {
+    if (i % 2 == 0)
+    {
+      const BuildingGeometry& g = all[rng() % all.size()].getGeometry();
+      points[i] = make_pair(g.CenterLat, g.CenterLon);
+    }
+    else
+    {
+      points[i] = make_pair(lat(rng), lon(rng));
+    }
+
+    double boxLat = lat(rng), boxLon = lon(rng);
+    double size = 0.01 * unit(rng);
+    boxes[i] = BoundingBox{ boxLat, boxLon, boxLat + size, boxLon + size * 1.34 };
+  }
+
+  size_t mismatches = 0;
+  size_t numFound = 0;
+  double tScan = 0, tIndex = 0;
+
+  for (const auto& p : points)
+  {
+    auto t0 = chrono::steady_clock::now();
+    vector<const Building*> scan = findContainingScan(buildings, nodes, p.first, p.second);
+    auto t1 = chrono::steady_clock::now();
+    vector<const Building*> indexed = buildings.findContaining(nodes, p.first, p.second);
+    auto t2 = chrono::steady_clock::now();
+
+    tScan += chrono::duration<double, micro>(t1 - t0).count();
+    tIndex += chrono::duration<double, micro>(t2 - t1).count();
+    numFound += indexed.size();
+
+    if (scan != indexed)
+    {
+      mismatches++;
+    }
+  }
+
+  cout << numBuildings << " buildings (resolved and indexed in " << resolveTime.count() << " ms, "
+       << buildings.getMemoryUsage() << " bytes with the index):" << endl
+       << "  findContaining: scan " << tScan / numQueries << " us, "
+       << "index " << tIndex / numQueries << " us per query, "
+       << (double) numFound / numQueries << " found"
+       << (mismatches == 0 ? "" : " (**ERROR: " + to_string(mismatches) + " queries disagree)") << endl;
+
+  //
+  // building_at on a copy and on a moved-to collection:
+  //
+  Buildings copied(buildings);
+  Buildings copy(buildings);
+  Buildings moved(std::move(copy));
+  size_t copyMismatches = 0;
+
+  for (const auto& p : points)
+  {
+    vector<const Building*> expected = buildings.findContaining(nodes, p.first, p.second);
+
+    if (!sameBuildings(copied.findContaining(nodes, p.first, p.second), expected, copied)
+        || !sameBuildings(moved.findContaining(nodes, p.first, p.second), expected, moved))
+    {
+      copyMismatches++;
+    }
+  }
+
+  if (copyMismatches > 0)
+  {
+    cout << "  **ERROR: a copied or moved collection disagrees on " << copyMismatches << " queries" << endl;
+  }
+
+  size_t boxMismatches = 0;
+  size_t numInBoxes = 0;
+  double tBoxScan = 0, tBoxIndex = 0;
+
+  for (const BoundingBox& box : boxes)
+  {
+    auto t0 = chrono::steady_clock::now();
+    vector<const Building*> scan = findInBoxScan(buildings, box);
+    auto t1 = chrono::steady_clock::now();
+    vector<const Building*> indexed = buildings.findInBox(box);
+    auto t2 = chrono::steady_clock::now();
+
+    tBoxScan += chrono::duration<double, micro>(t1 - t0).count();
+    tBoxIndex += chrono::duration<double, micro>(t2 - t1).count();
+    numInBoxes += indexed.size();
+
+    if (scan != indexed)
+    {
+      boxMismatches++;
+    }
+  }
+
+  cout << "  findInBox: scan " << tBoxScan / numQueries << " us, "
+       << "index " << tBoxIndex / numQueries << " us per query, "
+       << (double) numInBoxes / numQueries << " found"
+       << (boxMismatches == 0 ? "" : " (**ERROR: " + to_string(boxMismatches) + " queries disagree)") << endl;
+
+  return mismatches == 0 && boxMismatches == 0 && copyMismatches == 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+  size_t numQueries = argc > 1 ? strtoull(argv[1], nullptr, 10) : 20000;
+  bool ok = true;
+
+  for (size_t numBuildings : { 100, 1000, 10000, 100000, 500000 })
+  {
+    //
+    // fewer queries for many buildings, where the scan gets slow:
+    //
+    ok = runBench(numBuildings, min(numQueries, (size_t) 500000000 / numBuildings)) && ok;
+  }
+
+  cout << (ok ? "index and scan agree" : "**ERROR: index and scan disagree") << endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,180 @@
+/*coord_bench.cpp*/
+
+//
+// Accuracy check for fixed-point coordinates (see src/coord.h).
+//
+// Checks that:
+//
+//   - every 7-decimal coordinate, parsed as OSM's text is, comes back
+//     from fixed point as the identical double, so nothing computed
+//     from the map changes
+//   - arbitrary doubles come back within half a unit (0.5e-7 degree
+//     at the default precision)
+//   - distBetween2Points between points that went through fixed point
+//     differs from the distance between the original doubles by at
+//     most the half-unit error's worth, for short (campus) and long
+//     (continental) distances
+//
+// and reports bytes per node for the Nodes columns.
+//
+// Usage:
+//   make bench-coord
+//   ./coord_bench [count]
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include "coord.h"
+#include "dist.h"
+#include "nodes.h"
+#include "numparse.h"
+
+using namespace std;
+
+
+//
+// roundTrip
+//
+// The double a coordinate becomes once stored as fixed point.
+//
+static double roundTrip(double degrees)
+{
+  return fromFixedCoord(toFixedCoord(degrees));
+}
+
+//
+// maxDistanceError
+//
+// Largest |distance(fixed) - distance(double)| in feet over count
+// random pairs: the first point anywhere in [-80, 80] latitude, the
+// second within spread degrees of it.
+//
+static double maxDistanceError(mt19937_64& rng, int count, double spread)
+{
+  uniform_real_distribution<double> lat(-80.0, 80.0);
+  uniform_real_distribution<double> lon(-180.0 + spread, 180.0 - spread);
+  uniform_real_distribution<double> offset(-spread, spread);
+  double maxError = 0.0;
+
+  for (int i = 0; i < count; i++)
+  {
+    double lat1 = lat(rng), lon1 = lon(rng);
+    double lat2 = lat1 + offset(rng), lon2 = lon1 + offset(rng);
+
+    double exact = distBetween2Points(lat1, lon1, lat2, lon2);
+    double fixed = distBetween2Points(roundTrip(lat1), roundTrip(lon1), roundTrip(lat2), roundTrip(lon2));
+
+    maxError = max(maxError, fabs(fixed - exact) * 5280.0);
+  }
+
+  return maxError;
+}
+
+int main(int argc, char* argv[])
+{
+  int count = (argc > 1) ? atoi(argv[1]) : 1000000;
+  bool ok = true;
+  mt19937_64 rng(42);
+
+  cout << "COORD_DECIMALS " << COORD_DECIMALS << " (" << COORD_UNITS_PER_DEGREE << " units/degree)" << endl << endl;
+
+  //
+  // coordinates as OSM writes them, at the configured precision:
+  //
+  long long limit = (long long) (180 * COORD_UNITS_PER_DEGREE);
+  uniform_int_distribution<long long> units(-limit, limit);
+  size_t mismatches = 0;
+
+  for (int i = 0; i < count; i++)
+  {
+    long long n = units(rng);
+    long long whole = (long long) COORD_UNITS_PER_DEGREE;
+    char buf[32];
+
+    if (COORD_DECIMALS == 0)
+      snprintf(buf, sizeof(buf), "%lld", n);
+    else
+      snprintf(buf, sizeof(buf), "%s%lld.%0*lld", n < 0 ? "-" : "", llabs(n) / whole,
+               COORD_DECIMALS, llabs(n) % whole);
+
+    double parsed;
+    parseCoordinate(buf, parsed);
+    double back = roundTrip(parsed);
+
+    if (memcmp(&parsed, &back, sizeof(double)) != 0 || toFixedCoord(parsed) != n)
+    {
+      if (mismatches++ < 5)
+      {
+        cout << "  mismatch: '" << buf << "' parsed " << parsed << ", round trip " << back << endl;
+      }
+    }
+  }
+
+  cout << count << " " << COORD_DECIMALS << "-decimal coordinates: " << mismatches
+       << " not returned exactly" << endl;
+  ok = ok && mismatches == 0;
+
+  //
+  // arbitrary doubles:
+  //
+  uniform_real_distribution<double> degrees(-180.0, 180.0);
+  double maxError = 0.0;
+
+  for (int i = 0; i < count; i++)
+  {
+    double d = degrees(rng);
+    maxError = max(maxError, fabs(roundTrip(d) - d));
+  }
+
+  double halfUnit = 0.5 / COORD_UNITS_PER_DEGREE;
+  double metersPerDegree = 6371008.8 * M_PI / 180.0;
+
+  cout << count << " arbitrary doubles: max error " << maxError << " degree ("
+       << maxError * metersPerDegree * 100.0 << " cm), bound " << halfUnit << endl;
+  ok = ok && maxError <= halfUnit * (1 + 1e-9);
+
+  //
+  // distances: each endpoint moves at most halfUnit in lat and lon, so
+  // a distance can change by at most 2 * sqrt(2) * halfUnit degrees
+  // of arc:
+  //
+  double boundFeet = 2.0 * sqrt(2.0) * halfUnit * metersPerDegree / 0.3048;
+
+  cout << endl << "distBetween2Points, fixed point vs double (feet):" << endl;
+
+  struct { const char* Name; double Spread; } ranges[] = {
+    { "within 0.01 degree (~1 km)", 0.01 },
+    { "within 1 degree (~100 km)", 1.0 },
+    { "within 60 degrees", 60.0 },
+  };
+
+  for (auto& range : ranges)
+  {
+    double error = maxDistanceError(rng, count, range.Spread);
+
+    cout << "  " << range.Name << ": max " << error << " (bound " << boundFeet << ")" << endl;
+    ok = ok && error <= boundFeet * 1.01;
+  }
+
+  //
+  // memory:
+  //
+  Nodes nodes;
+  for (int i = 0; i < count; i++)
+  {
+    nodes.add(i, degrees(rng) / 2, degrees(rng), false);
+  }
+
+  cout << endl << "Nodes: " << (double) nodes.getMemoryUsage() / count << " bytes/node"
+       << " (doubles would be " << sizeof(long long) + 2 * sizeof(double) << " + entrance)" << endl;
+
+  cout << (ok ? "all checks pass" : "**ERROR: checks failed") << endl;
+  return ok ? 0 : 1;
+}
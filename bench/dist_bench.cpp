@@ -0,0 +1,147 @@
+/*dist_bench.cpp*/
+
+//
+// Microbenchmark for the distance functions (see src/dist.h).
+//
+// Measures pairs of points around Chicago, at campus, city and
+// region scales, and reports:
+//
+//   - the error of the approximate distance, chordSquaredToMiles,
+//     against distBetween2Points: largest relative and absolute, and
+//     the most it overstated the distance by (only by rounding)
+//   - that DistanceFrom::exact gives distBetween2Points bit for bit
+//   - time per distance: distBetween2Points, DistanceFrom::exact, and
+//     chordsSquared plus chordSquaredToMiles
+//
+// Usage:
+//   make bench-dist
+//   ./dist_bench [numPairs]
+//
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#include "dist.h"
+
+using namespace std;
+
+
+//
+// toUnitSphere
+//
+static void toUnitSphere(double lat, double lon, double& x, double& y, double& z)
+{
+  double phi = lat * M_PI / 180.0;
+  double lambda = lon * M_PI / 180.0;
+
+  x = cos(phi) * cos(lambda);
+  y = cos(phi) * sin(lambda);
+  z = sin(phi);
+}
+
+//
+// runScale
+//
+// Points up to maxMiles from a query near the Loop. Returns false if
+// exact and distBetween2Points ever differ.
+//
+static bool runScale(const char* scale, double maxMiles, size_t numPoints)
+{
+  mt19937_64 rng(42);
+  uniform_real_distribution<double> unit(0.0, 1.0);
+
+  double lat = 41.88, lon = -87.63;
+  double degrees = maxMiles / 69.0;  // of latitude, about
+
+  vector<double> lats(numPoints), lons(numPoints);
+  vector<double> xs(numPoints), ys(numPoints), zs(numPoints);
+
+  for (size_t i = 0; i < numPoints; i++)
+  {
+    double r = degrees * unit(rng);
+    double a = 2.0 * M_PI * unit(rng);
+
+    lats[i] = lat + r * sin(a);
+    lons[i] = lon + r * cos(a) / cos(lat * M_PI / 180.0);
+    toUnitSphere(lats[i], lons[i], xs[i], ys[i], zs[i]);
+  }
+
+  double qx, qy, qz;
+  toUnitSphere(lat, lon, qx, qy, qz);
+
+  vector<double> exact(numPoints), fromQuery(numPoints), chords(numPoints), approximate(numPoints);
+
+  auto t0 = chrono::steady_clock::now();
+  for (size_t i = 0; i < numPoints; i++)
+  {
+    exact[i] = distBetween2Points(lat, lon, lats[i], lons[i]);
+  }
+  auto t1 = chrono::steady_clock::now();
+  DistanceFrom from(lat, lon);
+  for (size_t i = 0; i < numPoints; i++)
+  {
+    fromQuery[i] = from.exact(lats[i], lons[i]);
+  }
+  auto t2 = chrono::steady_clock::now();
+  chordsSquared(qx, qy, qz, xs.data(), ys.data(), zs.data(), numPoints, chords.data());
+  for (size_t i = 0; i < numPoints; i++)
+  {
+    approximate[i] = chordSquaredToMiles(chords[i]);
+  }
+  auto t3 = chrono::steady_clock::now();
+
+  size_t differ = 0;
+  double maxRelative = 0, maxFeet = 0, maxOverFeet = 0;
+
+  for (size_t i = 0; i < numPoints; i++)
+  {
+    if (fromQuery[i] != exact[i])
+    {
+      differ++;
+    }
+
+    double error = exact[i] - approximate[i];
+    maxOverFeet = max(maxOverFeet, -error * 5280.0);
+    if (exact[i] > 0)
+    {
+      maxRelative = max(maxRelative, fabs(error) / exact[i]);
+    }
+    maxFeet = max(maxFeet, fabs(error) * 5280.0);
+  }
+
+  auto ns = [numPoints](chrono::steady_clock::duration d) {
+    return chrono::duration<double, nano>(d).count() / numPoints;
+  };
+
+  cout << scale << " (up to " << maxMiles << " miles):" << endl
+       << "  approximate: largest error " << maxRelative << " relative, " << maxFeet << " feet, "
+       << "over by at most " << maxOverFeet << " feet" << endl
+       << "  ns per distance: distBetween2Points " << ns(t1 - t0)
+       << ", DistanceFrom::exact " << ns(t2 - t1)
+       << ", chord (" << distanceKernelName(getDistanceKernel()) << ") " << ns(t3 - t2) << endl;
+
+  if (differ > 0)
+  {
+    cout << "  **ERROR: DistanceFrom::exact differs from distBetween2Points " << differ << " times" << endl;
+  }
+
+  return differ == 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+  size_t numPoints = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+  bool ok = true;
+
+  ok = runScale("campus", 1, numPoints) && ok;
+  ok = runScale("city", 30, numPoints) && ok;
+  ok = runScale("region", 300, numPoints) && ok;
+
+  return ok ? 0 : 1;
+}
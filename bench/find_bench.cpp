@@ -0,0 +1,356 @@
+/*find_bench.cpp*/
+
+//
+// Microbenchmark for Nodes::find on a large synthetic extract.
+//
+// Compares the columnar Nodes store, binary-searched ("sorted"), with
+// its Eytzinger and hash indexes and with its ids packed (see
+// nodeindex.h), with the
+// record layout it replaced (a vector of 32-byte Node records: id,
+// lat, lon, bool and padding, binary-searched by id) on:
+//
+//   - memory per node
+//   - time per lookup, for random ids (about half of them present)
+//   - time to prepare nodes added in random order for find
+//     (ensureOrder): sorting them, or hashing them unsorted
+//   - that appending one packed collection to another finds every
+//     node as the whole collection does, entrances included
+//   - cache lines touched per lookup by the binary searches: the
+//     distinct 64-byte lines their probes fall in, replayed from the
+//     probe addresses. Run under `perf stat -e cache-misses` for
+//     hardware counts where perf is available.
+//
+// Without a node count, runs 10^5, 10^6 and 10^7 nodes.
+//
+// Usage:
+//   make bench-find
+//   ./find_bench [numNodes] [numLookups]
+//
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <set>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+#include "nodes.h"
+
+using namespace std;
+
+
+//
+// RecordNode
+//
+// The old layout of one node.
+//
+struct RecordNode
+{
+  long long ID;
+  double Lat;
+  double Lon;
+  bool IsEntrance;
+};
+
+//
+// findRecord
+//
+// The old Nodes::find: binary search over the records.
+//
+static bool findRecord(const vector<RecordNode>& nodes, long long id, double& lat, double& lon, bool& isEntrance)
+{
+  int low = 0;
+  int high = (int) nodes.size() - 1;
+
+  while (low <= high)
+  {
+    int mid = low + ((high - low) / 2);
+    long long nodeid = nodes[mid].ID;
+
+    if (id == nodeid)
+    {
+      lat = nodes[mid].Lat;
+      lon = nodes[mid].Lon;
+      isEntrance = nodes[mid].IsEntrance;
+      return true;
+    }
+    else if (id < nodeid)
+      high = mid - 1;
+    else
+      low = mid + 1;
+  }
+
+  return false;
+}
+
+//
+// linesTouched
+//
+// Distinct cache lines touched by a binary search for id over
+// elements of the given size, where the id of element i is ids[i].
+// Assumes the array starts on a cache line.
+//
+static size_t linesTouched(const vector<long long>& ids, long long id, size_t elementSize, size_t extraLines)
+{
+  set<size_t> lines;
+  int low = 0;
+  int high = (int) ids.size() - 1;
+
+  while (low <= high)
+  {
+    int mid = low + ((high - low) / 2);
+    lines.insert(mid * elementSize / 64);
+
+    if (id == ids[mid])
+    {
+      return lines.size() + extraLines;  // + lines to read the payload
+    }
+    else if (id < ids[mid])
+      high = mid - 1;
+    else
+      low = mid + 1;
+  }
+
+  return lines.size();
+}
+
+template <typename Find>
+static double timeLookups(const vector<long long>& queries, long long& found, Find find)
+{
+  double lat, lon;
+  bool isEntrance;
+
+  found = 0;
+  auto start = chrono::steady_clock::now();
+
+  for (long long id : queries)
+  {
+    found += find(id, lat, lon, isEntrance) ? 1 : 0;
+  }
+
+  chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+  return elapsed.count() / queries.size();
+}
+
+
+//
+// runBench
+//
+// Runs the comparison for one map size. Returns false if the layouts
+// disagree on which ids are present.
+//
+static bool runBench(size_t numNodes, size_t numLookups)
+{
+  //
+  // ids with gaps, like a real extract; coordinates around Evanston:
+  //
+  mt19937_64 rng(42);
+  vector<long long> ids(numNodes);
+  long long id = 20000000;
+
+  for (size_t i = 0; i < numNodes; i++)
+  {
+    id += 1 + (long long) (rng() % 3);
+    ids[i] = id;
+  }
+
+  Nodes nodes;
+  vector<RecordNode> records;
+  records.reserve(numNodes);
+
+  for (size_t i = 0; i < numNodes; i++)
+  {
+    double lat = 42.0 + (double) (rng() % 1000000) / 1e7;
+    double lon = -87.7 + (double) (rng() % 1000000) / 1e7;
+    bool isEntrance = (rng() % 100) == 0;
+
+    nodes.add(ids[i], lat, lon, isEntrance);
+    records.push_back({ ids[i], lat, lon, isEntrance });
+  }
+
+  Nodes indexed = nodes;
+  size_t columnBytes = indexed.getMemoryUsage();
+  indexed.setIndexKind(NodeIndexKind::EYTZINGER);
+  indexed.ensureOrder(1);
+  size_t indexBytes = indexed.getMemoryUsage() - columnBytes;
+
+  Nodes hashed = nodes;
+  hashed.setIndexKind(NodeIndexKind::HASH);
+  hashed.ensureOrder(1);
+  size_t hashBytes = hashed.getMemoryUsage() - columnBytes;
+
+  Nodes packed = nodes;
+  packed.setIndexKind(NodeIndexKind::PACKED);
+  packed.ensureOrder(1);
+
+  vector<long long> queries(numLookups);
+  for (size_t i = 0; i < numLookups; i++)
+  {
+    queries[i] = ids.front() + (long long) (rng() % (uint64_t) (ids.back() - ids.front() + 1));
+  }
+
+  cout << numNodes << " nodes, " << numLookups << " random lookups" << endl << endl;
+
+  //
+  // memory:
+  //
+  cout << "bytes per node:" << endl;
+  cout << "  records: " << (double) (records.capacity() * sizeof(RecordNode)) / numNodes << endl;
+  cout << "  columns: " << (double) nodes.getMemoryUsage() / numNodes << endl;
+  cout << "  eytzinger index: +" << (double) indexBytes / numNodes << endl;
+  cout << "  hash index: +" << (double) hashBytes / numNodes << endl;
+  cout << "  columns, ids packed: " << (double) packed.getMemoryUsage() / numNodes << endl << endl;
+
+  //
+  // time, alternating a few rounds so no layout gets a warm cache:
+  //
+  double tRecords = 1e300, tColumns = 1e300, tIndexed = 1e300, tHashed = 1e300, tPacked = 1e300;
+  long long foundRecords = 0, foundColumns = 0, foundIndexed = 0, foundHashed = 0, foundPacked = 0;
+
+  for (int round = 0; round < 3; round++)
+  {
+    tRecords = min(tRecords, timeLookups(queries, foundRecords,
+      [&](long long q, double& lat, double& lon, bool& e) { return findRecord(records, q, lat, lon, e); }));
+    tColumns = min(tColumns, timeLookups(queries, foundColumns,
+      [&](long long q, double& lat, double& lon, bool& e) { return nodes.find(q, lat, lon, e); }));
+    tIndexed = min(tIndexed, timeLookups(queries, foundIndexed,
+      [&](long long q, double& lat, double& lon, bool& e) { return indexed.find(q, lat, lon, e); }));
+    tHashed = min(tHashed, timeLookups(queries, foundHashed,
+      [&](long long q, double& lat, double& lon, bool& e) { return hashed.find(q, lat, lon, e); }));
+    tPacked = min(tPacked, timeLookups(queries, foundPacked,
+      [&](long long q, double& lat, double& lon, bool& e) { return packed.find(q, lat, lon, e); }));
+  }
+
+  cout << "ns per lookup (best of 3):" << endl;
+  cout << "  records: " << tRecords << endl;
+  cout << "  columns: " << tColumns << endl;
+  cout << "  columns + eytzinger: " << tIndexed << endl;
+  cout << "  columns + hash: " << tHashed << endl;
+  cout << "  columns, ids packed: " << tPacked << endl << endl;
+
+  //
+  // cache lines: records hold the payload in the line already probed;
+  // columns read lat, lon and the entrance bits from 3 more lines.
+  //
+  double linesRecords = 0, linesColumns = 0;
+  size_t sample = min(numLookups, (size_t) 100000);
+
+  for (size_t i = 0; i < sample; i++)
+  {
+    linesRecords += linesTouched(ids, queries[i], sizeof(RecordNode), 0);
+    linesColumns += linesTouched(ids, queries[i], sizeof(long long), 3);
+  }
+
+  cout << "cache lines touched per lookup (incl. payload when found):" << endl;
+  cout << "  records: " << linesRecords / sample << endl;
+  cout << "  columns: " << linesColumns / sample << endl << endl;
+
+  //
+  // preparing shuffled nodes, sorting vs. hashing; both results must
+  // find the same nodes as the ordered columns:
+  //
+  vector<size_t> order(numNodes);
+  for (size_t i = 0; i < numNodes; i++)
+  {
+    order[i] = i;
+  }
+  shuffle(order.begin(), order.end(), rng);
+
+  Nodes shuffledSorted, shuffledHashed;
+  shuffledHashed.setIndexKind(NodeIndexKind::HASH);
+
+  for (size_t i : order)
+  {
+    const RecordNode& R = records[i];
+    shuffledSorted.add(R.ID, R.Lat, R.Lon, R.IsEntrance);
+    shuffledHashed.add(R.ID, R.Lat, R.Lon, R.IsEntrance);
+  }
+
+  auto timeEnsureOrder = [](Nodes& N) {
+    auto start = chrono::steady_clock::now();
+    N.ensureOrder(1);
+    chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count();
+  };
+
+  cout << "ms to prepare shuffled nodes (ensureOrder, 1 thread):" << endl;
+  cout << "  sort: " << timeEnsureOrder(shuffledSorted) << endl;
+  cout << "  hash: " << timeEnsureOrder(shuffledHashed) << endl << endl;
+
+  long long foundShuffledSorted, foundShuffledHashed;
+  timeLookups(queries, foundShuffledSorted,
+    [&](long long q, double& lat, double& lon, bool& e) { return shuffledSorted.find(q, lat, lon, e); });
+  timeLookups(queries, foundShuffledHashed,
+    [&](long long q, double& lat, double& lon, bool& e) { return shuffledHashed.find(q, lat, lon, e); });
+
+  //
+  // the two halves, each packed, appended and packed again:
+  //
+  Nodes firstHalf, secondHalf;
+  firstHalf.setIndexKind(NodeIndexKind::PACKED);
+  secondHalf.setIndexKind(NodeIndexKind::PACKED);
+
+  for (size_t i = 0; i < numNodes; i++)
+  {
+    const RecordNode& R = records[i];
+    (i < numNodes / 2 ? firstHalf : secondHalf).add(R.ID, R.Lat, R.Lon, R.IsEntrance);
+  }
+  firstHalf.ensureOrder(1);
+  secondHalf.ensureOrder(1);
+  firstHalf.append(secondHalf);
+  firstHalf.ensureOrder(1);
+
+  size_t appendMismatches = 0;
+  for (size_t i = 0; i < sample; i++)
+  {
+    double lat1 = 0, lon1 = 0, lat2 = 0, lon2 = 0;
+    bool e1 = false, e2 = false;
+    bool found1 = nodes.find(queries[i], lat1, lon1, e1);
+    bool found2 = firstHalf.find(queries[i], lat2, lon2, e2);
+
+    if (found1 != found2 || lat1 != lat2 || lon1 != lon2 || e1 != e2)
+    {
+      appendMismatches++;
+    }
+  }
+
+  bool ok = (foundRecords == foundColumns && foundColumns == foundIndexed && foundIndexed == foundHashed
+             && foundHashed == foundPacked && foundPacked == foundShuffledSorted && foundShuffledSorted == foundShuffledHashed);
+  cout << foundColumns << " of " << numLookups << " found"
+       << (ok ? "" : " (**ERROR: layouts disagree)") << endl;
+
+  if (appendMismatches > 0)
+  {
+    cout << "**ERROR: appended packed nodes disagree on " << appendMismatches << " lookups" << endl;
+  }
+
+  return ok && appendMismatches == 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+  vector<size_t> sizes = { 100000, 1000000, 10000000 };
+  size_t numLookups = argc > 2 ? strtoull(argv[2], nullptr, 10) : 2000000;
+
+  if (argc > 1)
+  {
+    sizes = { strtoull(argv[1], nullptr, 10) };
+  }
+
+  bool ok = true;
+
+  for (size_t i = 0; i < sizes.size(); i++)
+  {
+    if (i > 0)
+    {
+      cout << endl << "----" << endl << endl;
+    }
+
+    ok = runBench(sizes[i], numLookups) && ok;
+  }
+
+  return ok ? 0 : 1;
+}
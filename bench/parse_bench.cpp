@@ -0,0 +1,204 @@
+/*parse_bench.cpp*/
+
+//
+// Microbenchmark for number parsing (see src/numparse.h).
+//
+// Pulls every id, ref, lat and lon attribute value out of an OSM XML
+// file and parses them all, several times over, with:
+//
+//   - tinyxml2's XMLUtil::ToInt64 / ToDouble (sscanf), the path behind
+//     XMLAttribute::Int64Value / DoubleValue
+//   - strtoll / strtod on a NUL-terminated copy
+//   - std::from_chars
+//   - parseInt64 / parseCoordinate
+//
+// and checks that every method gives bit-identical results. Random
+// 7-digit coordinates are checked against strtod as well.
+//
+// Usage:
+//   make bench-parse
+//   ./parse_bench [map.osm] [repetitions]
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <charconv>
+#include <functional>
+
+#include "numparse.h"
+#include "tinyxml2.h"
+
+using namespace std;
+using namespace tinyxml2;
+
+
+//
+// attributeValues
+//
+// The values of every name="..." attribute in the text.
+//
+static vector<string> attributeValues(const string& text, const string& name)
+{
+  vector<string> values;
+  string pattern = " " + name + "=\"";
+
+  for (size_t pos = text.find(pattern); pos != string::npos; pos = text.find(pattern, pos))
+  {
+    pos += pattern.size();
+    size_t end = text.find('"', pos);
+    values.push_back(text.substr(pos, end - pos));
+  }
+
+  return values;
+}
+
+//
+// timeIt
+//
+// Runs parse over all values reps times; returns ns per value.
+//
+template <typename T>
+static double timeIt(const vector<string>& values, int reps, vector<T>& results,
+                     const function<T(const string&)>& parse)
+{
+  results.assign(values.size(), T());
+
+  auto start = chrono::steady_clock::now();
+  for (int r = 0; r < reps; r++)
+  {
+    for (size_t i = 0; i < values.size(); i++)
+    {
+      results[i] = parse(values[i]);
+    }
+  }
+  chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+
+  return elapsed.count() / ((double) values.size() * reps);
+}
+
+template <typename T>
+static bool sameBits(const vector<T>& a, const vector<T>& b)
+{
+  return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+  string filename = argc > 1 ? argv[1] : "data/nu.osm";
+  int reps = argc > 2 ? atoi(argv[2]) : 20;
+
+  ifstream infile(filename);
+  if (!infile.good())
+  {
+    cerr << "**ERROR: unable to open '" << filename << "'." << endl;
+    return 1;
+  }
+
+  stringstream contents;
+  contents << infile.rdbuf();
+  string text = contents.str();
+
+  vector<string> ids = attributeValues(text, "id");
+  vector<string> refs = attributeValues(text, "ref");
+  ids.insert(ids.end(), refs.begin(), refs.end());
+
+  vector<string> coords = attributeValues(text, "lat");
+  vector<string> lons = attributeValues(text, "lon");
+  coords.insert(coords.end(), lons.begin(), lons.end());
+
+  cout << filename << ": " << ids.size() << " ids/refs, " << coords.size()
+       << " coordinates, " << reps << " repetitions" << endl << endl;
+
+  bool ok = true;
+
+  //
+  // ids:
+  //
+  vector<long long> idsTiny, idsStrtoll, idsFromChars, idsParse;
+
+  double tTiny = timeIt<long long>(ids, reps, idsTiny, [](const string& s) {
+    int64_t v = 0; XMLUtil::ToInt64(s.c_str(), &v); return (long long) v; });
+  double tStrtoll = timeIt<long long>(ids, reps, idsStrtoll, [](const string& s) {
+    string copy(s); return strtoll(copy.c_str(), nullptr, 10); });
+  double tFromChars = timeIt<long long>(ids, reps, idsFromChars, [](const string& s) {
+    long long v = 0; from_chars(s.data(), s.data() + s.size(), v); return v; });
+  double tParse = timeIt<long long>(ids, reps, idsParse, [](const string& s) {
+    long long v; parseInt64(s, v); return v; });
+
+  ok = ok && sameBits(idsTiny, idsStrtoll) && sameBits(idsTiny, idsFromChars) && sameBits(idsTiny, idsParse);
+
+  cout << "ids (ns/value):" << endl;
+  cout << "  XMLUtil::ToInt64 (sscanf): " << tTiny << endl;
+  cout << "  strtoll (with copy):       " << tStrtoll << endl;
+  cout << "  from_chars:                " << tFromChars << endl;
+  cout << "  parseInt64:                " << tParse << endl << endl;
+
+  //
+  // coordinates:
+  //
+  vector<double> cTiny, cStrtod, cFromChars, cParse;
+
+  tTiny = timeIt<double>(coords, reps, cTiny, [](const string& s) {
+    double v = 0; XMLUtil::ToDouble(s.c_str(), &v); return v; });
+  double tStrtod = timeIt<double>(coords, reps, cStrtod, [](const string& s) {
+    string copy(s); return strtod(copy.c_str(), nullptr); });
+  tFromChars = timeIt<double>(coords, reps, cFromChars, [](const string& s) {
+    double v = 0; from_chars(s.data(), s.data() + s.size(), v); return v; });
+  tParse = timeIt<double>(coords, reps, cParse, [](const string& s) {
+    double v; parseCoordinate(s, v); return v; });
+
+  ok = ok && sameBits(cTiny, cStrtod) && sameBits(cTiny, cFromChars) && sameBits(cTiny, cParse);
+
+  cout << "coordinates (ns/value):" << endl;
+  cout << "  XMLUtil::ToDouble (sscanf): " << tTiny << endl;
+  cout << "  strtod (with copy):         " << tStrtod << endl;
+  cout << "  from_chars:                 " << tFromChars << endl;
+  cout << "  parseCoordinate:            " << tParse << endl << endl;
+
+  //
+  // random coordinates at OSM precision, and a few odd forms:
+  //
+  mt19937_64 rng(42);
+  uniform_int_distribution<long long> fixed(-1800000000LL, 1800000000LL);
+  vector<string> odd = { "0", "-0", "0.0000001", "-179.9999999", "42", "42.", ".5",
+                         "+42.5", " 42.5", "1e-7", "4.2e1", "12345678901234567890.5", "abc" };
+
+  for (int i = 0; i < 1000000; i++)
+  {
+    long long n = fixed(rng);
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%s%lld.%07lld", n < 0 ? "-" : "", llabs(n) / 10000000, llabs(n) % 10000000);
+    odd.push_back(buf);
+  }
+
+  size_t mismatches = 0;
+  for (const string& s : odd)
+  {
+    double expected = strtod(s.c_str(), nullptr);
+    double actual;
+    parseCoordinate(s, actual);
+
+    if (memcmp(&expected, &actual, sizeof(double)) != 0)
+    {
+      if (mismatches++ < 5)
+      {
+        cout << "  mismatch: '" << s << "' strtod " << expected << ", parseCoordinate " << actual << endl;
+      }
+    }
+  }
+
+  cout << odd.size() << " generated coordinates: " << mismatches << " mismatches vs strtod" << endl;
+  ok = ok && mismatches == 0;
+
+  cout << (ok ? "all methods agree" : "**ERROR: methods disagree") << endl;
+  return ok ? 0 : 1;
+}
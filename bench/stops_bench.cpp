@@ -0,0 +1,330 @@
+/*stops_bench.cpp*/
+
+//
+// Microbenchmark for BusStops::closestStops (see src/stopindex.h).
+//
+// Places synthetic stops over the CTA service area (a few of them at
+// the same spot as another stop, to exercise ties) and compares the
+// indexed closestStops with the scan over all stops it replaced, on:
+//
+//   - time per query, as the number of stops grows from the 12 in
+//     data/bus-stops.txt to about the whole CTA system and beyond
+//   - the stops found: both must return the same stops at the same
+//     distances for every query
+//
+// and likewise nearestStops, with random k, radius, routes and
+// directions, against sorting every stop that passes the filter; and
+// nearestStopsBatch, with each distance kernel (see dist.h), against
+// nearestStops one point at a time.
+//
+// It also checks that a stop added after indexing is found, without
+// calling buildIndex again.
+//
+// Usage:
+//   make bench-stops
+//   ./stops_bench [numQueries]
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <limits>
+#include <cstdlib>
+#include <algorithm>
+
+#include "busstops.h"
+#include "dist.h"
+#include "parallel.h"
+
+using namespace std;
+
+
+//
+// closestStopsScan
+//
+// The old closestStops: the distance to every stop.
+//
+static pair<const BusStop*, const BusStop*> closestStopsScan(ArrayView<BusStop> stops, double lat, double lon,
+                                                             double& distanceNorth, double& distanceSouth)
+{
+  const BusStop* north = nullptr;
+  const BusStop* south = nullptr;
+
+  distanceNorth = numeric_limits<double>::max();
+  distanceSouth = numeric_limits<double>::max();
+
+  for (const BusStop& B : stops)
+  {
+    double distance = distBetween2Points(lat, lon, B.getLat(), B.getLon());
+
+    if (B.getDirection() == "Northbound" && distance < distanceNorth)
+    {
+      north = &B;
+      distanceNorth = distance;
+    }
+    if (B.getDirection() == "Southbound" && distance < distanceSouth)
+    {
+      south = &B;
+      distanceSouth = distance;
+    }
+  }
+
+  return make_pair(north, south);
+}
+
+//
+// nearestStopsScan
+//
+// nearestStops by brute force: every stop that passes, sorted.
+//
+static vector<pair<double, size_t>> nearestStopsScan(ArrayView<BusStop> stops, double lat, double lon,
+                                                     size_t k, double radius, const StopFilter& filter)
+{
+  vector<pair<double, size_t>> found;
+
+  for (size_t i = 0; i < stops.size(); i++)
+  {
+    const BusStop& S = stops[i];
+    bool onRoute = filter.Routes.empty()
+      || find(filter.Routes.begin(), filter.Routes.end(), S.getRoute()) != filter.Routes.end();
+    bool inDirection = filter.Directions.empty()
+      || find(filter.Directions.begin(), filter.Directions.end(), S.getDirection()) != filter.Directions.end();
+    double distance = distBetween2Points(lat, lon, S.getLat(), S.getLon());
+
+    if (onRoute && inDirection && distance <= radius)
+    {
+      found.push_back(make_pair(distance, i));
+    }
+  }
+
+  sort(found.begin(), found.end());
+  if (found.size() > k)
+  {
+    found.resize(k);
+  }
+  return found;
+}
+
+//
+// runBench
+//
+// Runs the comparison for one number of stops. Returns false if the
+// two disagree on any query.
+//
+static bool runBench(size_t numStops, size_t numQueries)
+{
+  mt19937_64 rng(42);
+  uniform_real_distribution<double> lat(41.64, 42.07);
+  uniform_real_distribution<double> lon(-87.94, -87.52);
+  const char* directions[] = { "Northbound", "Southbound", "Eastbound", "Westbound" };
+  const char* routes[] = { "201", "205", "206", "213", "22", "36", "147", "151" };
+
+  BusStops busStops;
+
+  for (size_t i = 0; i < numStops; i++)
+  {
+    double stopLat = lat(rng), stopLon = lon(rng);
+
+    if (i % 50 == 49)
+    {
+      stopLat = busStops.getMapStops()[i / 2].getLat();  // same spot as an earlier stop
+      stopLon = busStops.getMapStops()[i / 2].getLon();
+    }
+
+    busStops.add(BusStop(to_string(i), routes[rng() % 8], "Stop " + to_string(i), directions[rng() % 4],
+                         "corner", stopLat, stopLon));
+  }
+
+  auto start = chrono::steady_clock::now();
+  busStops.buildIndex();
+  chrono::duration<double, milli> buildTime = chrono::steady_clock::now() - start;
+
+  //
+  // queries around the area, some of them right at a stop:
+  //
+  vector<pair<double, double>> queries(numQueries);
+  for (size_t i = 0; i < numQueries; i++)
+  {
+    if (i % 10 == 0)
+    {
+      const BusStop& S = busStops.getMapStops()[rng() % numStops];
+      queries[i] = make_pair(S.getLat(), S.getLon());
+    }
+    else
+    {
+      queries[i] = make_pair(lat(rng), lon(rng));
+    }
+  }
+
+  size_t mismatches = 0;
+  double tScan = 0, tIndex = 0;
+
+  for (const auto& q : queries)
+  {
+    double distanceNorth, distanceSouth;
+
+    auto t0 = chrono::steady_clock::now();
+    pair<const BusStop*, const BusStop*> scan = closestStopsScan(busStops.getMapStops(), q.first, q.second,
+                                                                 distanceNorth, distanceSouth);
+    auto t1 = chrono::steady_clock::now();
+    pair<BusStop, BusStop> indexed = busStops.closestStops(q.first, q.second);
+    auto t2 = chrono::steady_clock::now();
+
+    tScan += chrono::duration<double, micro>(t1 - t0).count();
+    tIndex += chrono::duration<double, micro>(t2 - t1).count();
+
+    bool same = scan.first != nullptr && scan.second != nullptr
+      && scan.first->getID() == indexed.first.getID() && distanceNorth == indexed.first.getDistance()
+      && scan.second->getID() == indexed.second.getID() && distanceSouth == indexed.second.getDistance();
+
+    if (!same)
+    {
+      mismatches++;
+    }
+  }
+
+  cout << numStops << " stops (index built in " << buildTime.count() << " ms): "
+       << "scan " << tScan / numQueries << " us, "
+       << "index " << tIndex / numQueries << " us per query"
+       << (mismatches == 0 ? "" : " (**ERROR: " + to_string(mismatches) + " queries disagree)") << endl;
+
+  //
+  // nearestStops: k up to 20, a radius of up to 2 miles or none, and
+  // up to 2 routes and 2 directions:
+  //
+  size_t nearMismatches = 0;
+  double tNearScan = 0, tNearIndex = 0;
+
+  for (const auto& q : queries)
+  {
+    size_t k = 1 + rng() % 20;
+    double radius = (rng() % 4 == 0) ? numeric_limits<double>::max() : (double) (rng() % 2000) / 1000.0;
+    StopFilter filter;
+
+    for (size_t r = rng() % 3; r > 0; r--)
+      filter.Routes.push_back(routes[rng() % 8]);
+    for (size_t d = rng() % 3; d > 0; d--)
+      filter.Directions.push_back(directions[rng() % 4]);
+
+    auto t0 = chrono::steady_clock::now();
+    vector<pair<double, size_t>> scan = nearestStopsScan(busStops.getMapStops(), q.first, q.second, k, radius, filter);
+    auto t1 = chrono::steady_clock::now();
+    vector<NearbyStop> indexed = busStops.nearestStops(q.first, q.second, k, radius, filter);
+    auto t2 = chrono::steady_clock::now();
+
+    tNearScan += chrono::duration<double, micro>(t1 - t0).count();
+    tNearIndex += chrono::duration<double, micro>(t2 - t1).count();
+
+    bool same = scan.size() == indexed.size();
+    for (size_t i = 0; same && i < scan.size(); i++)
+    {
+      same = scan[i].first == indexed[i].Distance && &busStops.getMapStops()[scan[i].second] == indexed[i].Stop;
+    }
+
+    if (!same)
+    {
+      nearMismatches++;
+    }
+  }
+
+  cout << "  nearestStops: scan " << tNearScan / numQueries << " us, "
+       << "index " << tNearIndex / numQueries << " us per query"
+       << (nearMismatches == 0 ? "" : " (**ERROR: " + to_string(nearMismatches) + " queries disagree)") << endl;
+
+  //
+  // nearestStopsBatch: all the queries at once, the 10 nearest stops
+  // to each, with each kernel the CPU has:
+  //
+  StopFilter anyStop;
+  vector<vector<NearbyStop>> expected;
+
+  auto t0 = chrono::steady_clock::now();
+  for (const auto& q : queries)
+  {
+    expected.push_back(busStops.nearestStops(q.first, q.second, 10, numeric_limits<double>::max(), anyStop));
+  }
+  double tOneByOne = chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count();
+
+  cout << "  nearestStopsBatch (k = 10): one by one " << tOneByOne / numQueries << " us";
+
+  DistanceKernel defaultKernel = getDistanceKernel();
+  size_t batchMismatches = 0;
+
+  for (DistanceKernel kernel : { DistanceKernel::SCALAR, DistanceKernel::AVX2 })
+  {
+    if (!setDistanceKernel(kernel))
+    {
+      continue;
+    }
+
+    vector<int> threadCounts = { 1 };
+    if (defaultThreadCount() > 1)
+    {
+      threadCounts.push_back(defaultThreadCount());
+    }
+
+    for (int numThreads : threadCounts)
+    {
+      auto t1 = chrono::steady_clock::now();
+      vector<vector<NearbyStop>> batch = busStops.nearestStopsBatch(queries, 10, numeric_limits<double>::max(),
+                                                                    anyStop, numThreads);
+      double tBatch = chrono::duration<double, micro>(chrono::steady_clock::now() - t1).count();
+
+      for (size_t i = 0; i < numQueries; i++)
+      {
+        bool same = batch[i].size() == expected[i].size();
+        for (size_t j = 0; same && j < batch[i].size(); j++)
+        {
+          same = batch[i][j].Stop == expected[i][j].Stop && batch[i][j].Distance == expected[i][j].Distance;
+        }
+
+        if (!same)
+        {
+          batchMismatches++;
+        }
+      }
+
+      cout << ", " << distanceKernelName(kernel) << " x" << numThreads << " " << tBatch / numQueries << " us";
+    }
+  }
+
+  setDistanceKernel(defaultKernel);
+
+  cout << " per point"
+       << (batchMismatches == 0 ? "" : " (**ERROR: " + to_string(batchMismatches) + " points disagree)") << endl;
+
+  //
+  // a stop added after indexing, away from the others, must be the
+  // nearest to its own spot:
+  //
+  busStops.add(BusStop("added", routes[0], "Added stop", directions[0], "corner", 42.5, -87.0));
+  vector<NearbyStop> added = busStops.nearestStops(42.5, -87.0, 1, numeric_limits<double>::max(), anyStop);
+  bool foundAdded = added.size() == 1 && added[0].Stop->getID() == "added";
+
+  if (!foundAdded)
+  {
+    cout << "  **ERROR: a stop added after indexing is not found" << endl;
+  }
+
+  return mismatches == 0 && nearMismatches == 0 && batchMismatches == 0 && foundAdded;
+}
+
+
+int main(int argc, char* argv[])
+{
+  size_t numQueries = argc > 1 ? strtoull(argv[1], nullptr, 10) : 20000;
+  bool ok = true;
+
+  for (size_t numStops : { 12, 100, 1000, 11000, 100000 })
+  {
+    //
+    // fewer queries for many stops, where the scan gets slow:
+    //
+    ok = runBench(numStops, min(numQueries, (size_t) 200000000 / numStops)) && ok;
+  }
+
+  cout << (ok ? "index and scan agree" : "**ERROR: index and scan disagree") << endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,47 @@
+/*arrayview.h*/
+
+//
+// A read-only view of an array stored elsewhere.
+//
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+using namespace std;
+
+
+//
+// ArrayView
+//
+// A read-only view of count elements stored elsewhere (e.g. a
+// building's node IDs, stored by its Buildings collection), which
+// range-for loops can iterate without copying them.
+//
+template <typename T>
+class ArrayView
+{
+private:
+  const T* First;
+  size_t Count;
+
+public:
+  ArrayView(const T* first, size_t count)
+    : First(first), Count(count)
+  {
+  }
+
+  ArrayView(const vector<T>& v)
+    : First(v.data()), Count(v.size())
+  {
+  }
+
+  const T* begin() const { return this->First; }
+  const T* end() const { return this->First + this->Count; }
+  size_t size() const { return this->Count; }
+  bool empty() const { return this->Count == 0; }
+  const T& operator[](size_t i) const { return this->First[i]; }
+  const T& front() const { return this->First[0]; }
+  const T& back() const { return this->First[this->Count - 1]; }
+};
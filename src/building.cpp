@@ -4,35 +4,150 @@
 // 
 
 #include "building.h"
+#include "buildings.h"
 #include "nodes.h"
 #include "busstops.h"
 #include "curl_util.h"
 #include "building.h"
 #include <utility>
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 
 using namespace std;
 
 //
 // constructor
 //
-Building::Building(long long id, string name, string streetAddr)
-    : ID(id), Name(name), StreetAddress(streetAddr)
+Building::Building(long long id, const Buildings* owner)
+    : ID(id), Owner(owner), NameOffset(0), NameLength(0), AddressOffset(0), AddressLength(0),
+      FirstNodeID(0), NumNodeIDs(0), NumNodeIndices(0), FirstEntrance(0), NumEntrances(0),
+      NodesResolved(false)
     {
     }
 
-void Building::add(long long nodeid)
+//
+// an outline is closed if its last node repeats the first
+//
+bool Building::isClosed() const
+{
+    ArrayView<long long> nodeIDs = this->getNodeIDs();
+    return nodeIDs.size() > 1 && nodeIDs.front() == nodeIDs.back();
+}
+
+//
+// resolves the node IDs to indices into the nodes, dropping the
+// dangling ones (getLocation skips those anyway) and the node that
+// closes the ring, then computes the geometry
+//
+int Building::resolveNodes(const Nodes& nodes, uint32_t* indices, vector<Coord>& entrances)
 {
-    this->NodeIDs.push_back(nodeid);
+    ArrayView<long long> nodeIDs = this->getNodeIDs();
+    int dangling = 0;
+    size_t numVertices = this->isClosed() ? nodeIDs.size() - 1 : nodeIDs.size();
+
+    this->NumNodeIndices = 0;
+
+    for (size_t i = 0; i < nodeIDs.size(); i++)
+    {
+        size_t index;
+
+        if (!nodes.findIndex(nodeIDs[i], index))
+        {
+            dangling++;
+        }
+        else if (i < numVertices)
+        {
+            indices[this->NumNodeIndices++] = (uint32_t) index;
+        }
+    }
+
+    this->computeGeometry(nodes, indices, dangling == 0, entrances);
+    this->NodesResolved = true;
+    return dangling;
+}
+
+//
+// computes the center, bounding box and entrances from the resolved
+// nodes, and the area if the outline is a complete closed ring: the
+// shoelace formula over the nodes projected onto a plane tangent at
+// the center (east-west distances shrink by cos(latitude)), which is
+// accurate to well under 1% at building scale
+//
+void Building::computeGeometry(const Nodes& nodes, const uint32_t* indices, bool complete,
+                               vector<Coord>& entrances)
+{
+    BuildingGeometry g;
+    size_t n = this->NumNodeIndices;
+
+    this->FirstEntrance = (uint32_t) entrances.size();
+    this->NumEntrances = 0;
+
+    if (n == 0)
+    {
+        this->Geometry = g;
+        return;
+    }
+
+    double sumLat = 0.0, sumLon = 0.0;
+    g.MinLat = g.MaxLat = nodes.getLat(indices[0]);
+    g.MinLon = g.MaxLon = nodes.getLon(indices[0]);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t index = indices[i];
+        double lat = nodes.getLat(index);
+        double lon = nodes.getLon(index);
+
+        sumLat += lat;
+        sumLon += lon;
+        g.MinLat = min(g.MinLat, lat);
+        g.MaxLat = max(g.MaxLat, lat);
+        g.MinLon = min(g.MinLon, lon);
+        g.MaxLon = max(g.MaxLon, lon);
+
+        if (nodes.isEntrance(index))
+        {
+            entrances.push_back(nodes.getCoord(index));
+            this->NumEntrances++;
+        }
+    }
+
+    g.CenterLat = sumLat / n;
+    g.CenterLon = sumLon / n;
+
+    if (complete && this->isClosed() && n >= 3)
+    {
+        const double metersPerDegree = 6371008.8 * M_PI / 180.0;  // mean Earth radius
+        double xScale = metersPerDegree * cos(g.CenterLat * M_PI / 180.0);
+        double twiceArea = 0.0;
+
+        for (size_t i = 0; i < n; i++)
+        {
+            uint32_t a = indices[i];
+            uint32_t b = indices[(i + 1) % n];
+
+            double xa = (nodes.getLon(a) - g.CenterLon) * xScale;
+            double ya = (nodes.getLat(a) - g.CenterLat) * metersPerDegree;
+            double xb = (nodes.getLon(b) - g.CenterLon) * xScale;
+            double yb = (nodes.getLat(b) - g.CenterLat) * metersPerDegree;
+
+            twiceArea += xa * yb - xb * ya;
+        }
+
+        g.Area = fabs(twiceArea) / 2.0;
+    }
+
+    this->Geometry = g;
 }
 
 //
 // print prints the attributes of the building 
 //
-void Building::print(const Nodes& nodes, BusStops& busStops, CURL* curl)
+void Building::print(const Nodes& nodes, BusStops& busStops, CURL* curl) const
 { 
-    cout << Name << endl << "Address: " << StreetAddress << endl << "Building ID: "  << ID << endl;
-    cout << "# perimeter nodes: " << NodeIDs.size() << endl;       
+    cout << this->getName() << endl << "Address: " << this->getStreetAddress() << endl << "Building ID: "  << ID << endl;
+    cout << "# perimeter nodes: " << NumNodeIDs << endl;       
     pair <double, double> location = this->getLocation(nodes);
     cout << "Location: (" << location.first << ", " << location.second << ")" << endl;
     
@@ -71,15 +186,26 @@ void Building::print(const Nodes& nodes, BusStops& busStops, CURL* curl)
 // on the nodes that form the perimeter
 pair<double, double> Building::getLocation(const Nodes& nodes) const
 {   
+    if (NodesResolved)
+    {
+        return make_pair(Geometry.CenterLat, Geometry.CenterLon);
+    }
+
+    //
+    // not resolved: search for each node (the node closing the ring
+    // counts once, as in computeGeometry)
+    //
+    ArrayView<long long> nodeIDs = this->getNodeIDs();
     double sumLat = 0.0, sumLon = 0.0;
     int count = 0;
+    size_t numVertices = this->isClosed() ? nodeIDs.size() - 1 : nodeIDs.size();
 
-    for (long long id : NodeIDs)
+    for (size_t i = 0; i < numVertices; i++)
     {
         double lat, lon;
         bool isEntrance;
 
-        if(nodes.find(id, lat, lon, isEntrance))
+        if(nodes.find(nodeIDs[i], lat, lon, isEntrance))
         {
             sumLat += lat;
             sumLon += lon;
@@ -97,25 +223,70 @@ pair<double, double> Building::getLocation(const Nodes& nodes) const
 
 
 }
+const BuildingGeometry& Building::getGeometry() const
+{
+    return this->Geometry;
+}
+
+ArrayView<Coord> Building::getEntrances() const
+{
+    return ArrayView<Coord>(this->Owner->Entrances.data() + this->FirstEntrance, this->NumEntrances);
+}
+
+//
+// contains casts a ray from the point toward increasing longitude and
+// counts the outline edges it crosses: an odd count means inside. The
+// outline is treated as flat in (lat, lon), which at building scale
+// is exact enough. The bounding box rules most points out first.
+//
+bool Building::contains(const Nodes& nodes, double lat, double lon) const
+{
+    const BuildingGeometry& g = this->Geometry;
+    size_t n = this->NumNodeIndices;
+
+    if (!this->NodesResolved || !this->isClosed() || n < 3
+        || lat < g.MinLat || lat > g.MaxLat || lon < g.MinLon || lon > g.MaxLon)
+    {
+        return false;
+    }
+
+    const uint32_t* indices = this->Owner->NodeIndices.data() + this->FirstNodeID;
+    bool inside = false;
+
+    for (size_t i = 0, j = n - 1; i < n; j = i++)
+    {
+        double latI = nodes.getLat(indices[i]), lonI = nodes.getLon(indices[i]);
+        double latJ = nodes.getLat(indices[j]), lonJ = nodes.getLon(indices[j]);
+
+        if ((latI > lat) != (latJ > lat)
+            && lon < (lonJ - lonI) * (lat - latI) / (latJ - latI) + lonI)
+        {
+            inside = !inside;
+        }
+    }
+
+    return inside;
+}
+
 //
-// accessors / getters
+// accessors / getters (views into the owner's arrays)
 //
 long long Building::getID() const
 {
     return this->ID;
 }
 
-string Building::getName() const
+string_view Building::getName() const
 {
-    return this->Name;
+    return string_view(this->Owner->Strings.data() + this->NameOffset, this->NameLength);
 }
 
-string Building::getStreetAddress() const
+string_view Building::getStreetAddress() const
 {
-    return this->StreetAddress;
+    return string_view(this->Owner->Strings.data() + this->AddressOffset, this->AddressLength);
 }
 
-vector<long long> Building::getNodeIDs() const
+ArrayView<long long> Building::getNodeIDs() const
 {
-    return this->NodeIDs;
-}
\ No newline at end of file
+    return ArrayView<long long>(this->Owner->NodeRefs.data() + this->FirstNodeID, this->NumNodeIDs);
+}
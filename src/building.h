@@ -8,9 +8,14 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
 
-#include "node.h"
+#include "arrayview.h"
+#include "coord.h"
 #include <iostream>
 #include "nodes.h"
 #include "busstops.h"
@@ -19,6 +24,32 @@
 
 using namespace std;
 
+class Buildings;
+
+
+//
+// BuildingGeometry
+//
+// What a building's outline works out to, computed once when its
+// nodes are resolved. An outline is a closed ring whose last node
+// repeats the first; the repeated node counts once.
+//
+struct BuildingGeometry
+{
+  double CenterLat;   // average of the outline's nodes
+  double CenterLon;
+  double MinLat;      // bounding box
+  double MinLon;
+  double MaxLat;
+  double MaxLon;
+  double Area;        // in square meters; 0 unless a complete closed ring
+
+  BuildingGeometry()
+    : CenterLat(0), CenterLon(0), MinLat(0), MinLon(0), MaxLat(0), MaxLon(0), Area(0)
+  {
+  }
+};
+
 
 //
 // Building
@@ -26,43 +57,89 @@ using namespace std;
 // Defines a campus building with a name (e.g. "Mudd"), a street
 // address (e.g. "2233 Tech Dr"), and the IDs of the nodes that
 // define the position / outline of the building.
+//
+// A Building is a fixed-size record: its name, address, node IDs,
+// resolved node indices and entrances are stored by the Buildings
+// collection it belongs to, all buildings' together in a few flat
+// arrays (see buildings.h), and the getters return views into them.
+// Buildings are created with Buildings::add.
+//
+// Once the map is loaded, resolveNodes looks each node ID up once,
+// keeps the node's index in the Nodes columns and computes the
+// building's geometry from them, so getLocation and getGeometry just
+// return the stored results.
 // 
 // NOTE: the Name could be empty "", the HouseNumber could be
 // empty, and the Street could be empty. Imperfect data.
 //
 class Building
 {
-
   long long ID;
-  string Name;
-  string StreetAddress;
-  vector<long long> NodeIDs;
+  const Buildings* Owner;
 
-public:
   //
-  // constructor
+  // ranges of the owner's arrays (see Buildings):
   //
-  Building(long long id, string name, string streetAddr);
+  uint32_t NameOffset;       // Strings
+  uint32_t NameLength;
+  uint32_t AddressOffset;
+  uint32_t AddressLength;
+  uint32_t FirstNodeID;      // NodeRefs, and NodeIndices once resolved
+  uint32_t NumNodeIDs;
+  uint32_t NumNodeIndices;   // of the NodeIDs found (closing node once)
+  uint32_t FirstEntrance;    // Entrances
+  uint32_t NumEntrances;
+  bool NodesResolved;
+
+  BuildingGeometry Geometry;
+
+  Building(long long id, const Buildings* owner);
+
+  bool isClosed() const;
 
   //
-  // adds the given nodeid to the end of the vector.
+  // resolveNodes looks up the building's node IDs in the given nodes,
+  // stores their indices in indices and the positions of entrances in
+  // entrances, and computes the geometry, returning how many IDs were
+  // not found (dangling). Called by Buildings::resolveNodes.
   //
-  void add(long long nodeid);
+  int resolveNodes(const Nodes& nodes, uint32_t* indices, vector<Coord>& entrances);
+  void computeGeometry(const Nodes& nodes, const uint32_t* indices, bool complete,
+                       vector<Coord>& entrances);
+
+  friend class Buildings;
+
+public:
   //
   // print prints the parameter of a building
   //
-  void print(const Nodes& nodes, BusStops& busStops, CURL* curl);
+  void print(const Nodes& nodes, BusStops& busStops, CURL* curl) const;
   //
   //
   // gets the center (lat, lon) of the building based
   // on the nodes that form the perimeter
   pair<double, double> getLocation(const Nodes& nodes) const;
   //
+  // gets the geometry computed by resolveNodes (all zero before)
+  //
+  const BuildingGeometry& getGeometry() const;
+  //
+  // gets the positions of the entrance nodes on the outline, found
+  // by resolveNodes (none before)
+  //
+  ArrayView<Coord> getEntrances() const;
+  //
+  // contains returns true if (lat, lon) is inside the building's
+  // closed outline, once resolveNodes has run (outline nodes missing
+  // from the map are left out of it)
+  //
+  bool contains(const Nodes& nodes, double lat, double lon) const;
+  //
   // accessor
   // 
   long long getID() const;
-  string getName() const;
-  string getStreetAddress() const;
-  vector<long long> getNodeIDs() const;
+  string_view getName() const;
+  string_view getStreetAddress() const;
+  ArrayView<long long> getNodeIDs() const;
 
 };
@@ -0,0 +1,184 @@
+/*buildingindex.cpp*/
+
+//
+// Spatial index over building bounding boxes.
+//
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "buildingindex.h"
+
+using namespace std;
+
+
+BuildingIndex::BuildingIndex()
+  : NumLeaves(0)
+{
+}
+
+//
+// unionOf
+//
+// The smallest box holding entries[lo .. hi-1]'s boxes.
+//
+template <typename T>
+static BoundingBox unionOf(const vector<T>& entries, size_t lo, size_t hi)
+{
+  BoundingBox box = entries[lo].Bounds;
+
+  for (size_t i = lo + 1; i < hi; i++)
+  {
+    const BoundingBox& b = entries[i].Bounds;
+    box.MinLat = min(box.MinLat, b.MinLat);
+    box.MinLon = min(box.MinLon, b.MinLon);
+    box.MaxLat = max(box.MaxLat, b.MaxLat);
+    box.MaxLon = max(box.MaxLon, b.MaxLon);
+  }
+
+  return box;
+}
+
+//
+// sortTiles
+//
+// Orders entries[lo .. hi-1] so that each run of NodeCapacity is one
+// tile: sorted by center longitude into vertical slices of
+// sqrt(number of tiles) tiles each, and each slice by center latitude.
+//
+template <typename T>
+void BuildingIndex::sortTiles(vector<T>& entries, size_t lo, size_t hi)
+{
+  size_t n = hi - lo;
+  size_t numTiles = (n + NodeCapacity - 1) / NodeCapacity;
+  size_t numSlices = (size_t) ceil(sqrt((double) numTiles));
+  size_t sliceSize = ((numTiles + numSlices - 1) / numSlices) * NodeCapacity;
+
+  auto byLon = [](const T& e1, const T& e2) {
+    return e1.Bounds.MinLon + e1.Bounds.MaxLon < e2.Bounds.MinLon + e2.Bounds.MaxLon;
+  };
+  auto byLat = [](const T& e1, const T& e2) {
+    return e1.Bounds.MinLat + e1.Bounds.MaxLat < e2.Bounds.MinLat + e2.Bounds.MaxLat;
+  };
+
+  sort(entries.begin() + lo, entries.begin() + hi, byLon);
+
+  for (size_t s = lo; s < hi; s += sliceSize)
+  {
+    sort(entries.begin() + s, entries.begin() + min(hi, s + sliceSize), byLat);
+  }
+}
+
+//
+// build
+//
+// Packs the items into leaves, then each level's nodes into the level
+// above, until one node is left.
+//
+void BuildingIndex::build(const vector<BoundingBox>& boxes, const vector<uint32_t>& positions)
+{
+  this->clear();
+
+  for (size_t i = 0; i < boxes.size(); i++)
+  {
+    this->Items.push_back(Item{ boxes[i], positions[i] });
+  }
+
+  if (this->Items.empty())
+  {
+    return;
+  }
+
+  sortTiles(this->Items, 0, this->Items.size());
+
+  for (size_t i = 0; i < this->Items.size(); i += NodeCapacity)
+  {
+    size_t end = min(this->Items.size(), i + NodeCapacity);
+    this->Nodes.push_back(Node{ unionOf(this->Items, i, end), (uint32_t) i, (uint32_t) (end - i) });
+  }
+
+  this->NumLeaves = this->Nodes.size();
+
+  size_t levelStart = 0;
+  size_t levelEnd = this->Nodes.size();
+
+  while (levelEnd - levelStart > 1)
+  {
+    sortTiles(this->Nodes, levelStart, levelEnd);
+
+    for (size_t i = levelStart; i < levelEnd; i += NodeCapacity)
+    {
+      size_t end = min(levelEnd, i + NodeCapacity);
+      this->Nodes.push_back(Node{ unionOf(this->Nodes, i, end), (uint32_t) i, (uint32_t) (end - i) });
+    }
+
+    levelStart = levelEnd;
+    levelEnd = this->Nodes.size();
+  }
+}
+
+void BuildingIndex::clear()
+{
+  this->Items = vector<Item>();
+  this->Nodes = vector<Node>();
+  this->NumLeaves = 0;
+}
+
+//
+// search
+//
+// Walks down from the root with an explicit stack, into every child
+// whose box intersects the query.
+//
+void BuildingIndex::search(const BoundingBox& box, vector<uint32_t>& found) const
+{
+  if (this->Nodes.empty())
+  {
+    return;
+  }
+
+  //
+  // each level down adds at most M-1 entries, and 2^32 items make at
+  // most 8 levels:
+  //
+  uint32_t stack[8 * NodeCapacity];
+  size_t depth = 0;
+  size_t root = this->Nodes.size() - 1;
+
+  if (!this->Nodes[root].Bounds.intersects(box))
+  {
+    return;
+  }
+
+  stack[depth++] = (uint32_t) root;
+
+  while (depth > 0)
+  {
+    const Node& node = this->Nodes[stack[--depth]];
+    bool leaf = (size_t) (&node - this->Nodes.data()) < this->NumLeaves;
+
+    for (uint32_t c = node.First; c < node.First + node.Count; c++)
+    {
+      if (leaf)
+      {
+        if (this->Items[c].Bounds.intersects(box))
+          found.push_back(this->Items[c].Building);
+      }
+      else if (this->Nodes[c].Bounds.intersects(box))
+      {
+        stack[depth++] = c;
+      }
+    }
+  }
+}
+
+size_t BuildingIndex::size() const
+{
+  return this->Items.size();
+}
+
+size_t BuildingIndex::getMemoryUsage() const
+{
+  return this->Items.capacity() * sizeof(Item) + this->Nodes.capacity() * sizeof(Node);
+}
@@ -0,0 +1,114 @@
+/*buildingindex.h*/
+
+//
+// Spatial index over building bounding boxes (see buildings.h).
+//
+// BuildingIndex is an R-tree packed with the Sort-Tile-Recursive
+// algorithm: the boxes are sorted by the longitude of their centers
+// and cut into about sqrt(n / M) vertical slices, each slice is sorted
+// by latitude and cut into runs of M boxes, and each run becomes a
+// leaf; the leaves are packed the same way into the level above, and
+// so on up to a single root. Packing a static set of boxes this way
+// fills every node and keeps sibling boxes from overlapping much, so
+// a small query visits about one path down the tree plus the leaves
+// it covers.
+//
+// All nodes are stored in one array, level by level from the leaves
+// up, and each node's children sit next to each other, so a node is
+// just its box and a range.
+//
+// Reference:
+//
+//   S. Leutenegger, M. Lopez and J. Edgington, "STR: A Simple and
+//   Efficient Algorithm for R-Tree Packing", ICDE 1997
+//
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+
+//
+// BoundingBox
+//
+// A (lat, lon) rectangle, edges included.
+//
+struct BoundingBox
+{
+  double MinLat;
+  double MinLon;
+  double MaxLat;
+  double MaxLon;
+
+  bool intersects(const BoundingBox& other) const
+  {
+    return this->MinLat <= other.MaxLat && other.MinLat <= this->MaxLat
+      && this->MinLon <= other.MaxLon && other.MinLon <= this->MaxLon;
+  }
+};
+
+
+class BuildingIndex
+{
+private:
+  static constexpr size_t NodeCapacity = 16;  // M
+
+  struct Item
+  {
+    BoundingBox Bounds;
+    uint32_t Building;  // position in the buildings the index was built over
+  };
+
+  struct Node
+  {
+    BoundingBox Bounds;
+    uint32_t First;  // children: Items (leaves) or Nodes, First .. First+Count-1
+    uint32_t Count;
+  };
+
+  vector<Item> Items;
+  vector<Node> Nodes;
+  size_t NumLeaves;  // Nodes[0 .. NumLeaves-1] are the leaves; the root is last
+
+  template <typename T>
+  static void sortTiles(vector<T>& entries, size_t lo, size_t hi);
+
+public:
+  BuildingIndex();
+
+  //
+  // build
+  //
+  // Builds the index over the given boxes; boxes[i] is the box of
+  // the building at position positions[i].
+  //
+  void build(const vector<BoundingBox>& boxes, const vector<uint32_t>& positions);
+
+  //
+  // clear
+  //
+  // Empties the index.
+  //
+  void clear();
+
+  //
+  // search
+  //
+  // Finds the buildings whose box intersects the given box (a point
+  // if min == max), adding their positions to found, in no particular
+  // order.
+  //
+  void search(const BoundingBox& box, vector<uint32_t>& found) const;
+
+  //
+  // size / getMemoryUsage
+  //
+  // The number of boxes, and the bytes used by the index.
+  //
+  size_t size() const;
+  size_t getMemoryUsage() const;
+};
@@ -12,13 +12,167 @@
 #include "buildings.h"
 #include "busstops.h"
 #include "busstop.h"
+#include "numparse.h"
 #include "osm.h"
+#include "parallel.h"
 #include "tinyxml2.h"
 #include "curl_util.h"
 
 using namespace std;
 using namespace tinyxml2;
 
+
+//
+// constructors / assignment
+//
+// Buildings point back at the collection that stores their data, so
+// a copied or moved collection re-points its buildings at itself. The
+// index holds positions, not pointers, so it is copied as it is.
+//
+Buildings::Buildings()
+{
+}
+
+Buildings::Buildings(const Buildings& other)
+  : NodeRefs(other.NodeRefs), NodeIndices(other.NodeIndices), Entrances(other.Entrances),
+    Strings(other.Strings), Index(other.Index), MapBuildings(other.MapBuildings)
+{
+  this->adopt();
+}
+
+Buildings::Buildings(Buildings&& other)
+  : NodeRefs(std::move(other.NodeRefs)), NodeIndices(std::move(other.NodeIndices)),
+    Entrances(std::move(other.Entrances)), Strings(std::move(other.Strings)),
+    Index(std::move(other.Index)), MapBuildings(std::move(other.MapBuildings))
+{
+  this->adopt();
+}
+
+Buildings& Buildings::operator=(const Buildings& other)
+{
+  Buildings copy(other);
+  *this = std::move(copy);
+  return *this;
+}
+
+Buildings& Buildings::operator=(Buildings&& other)
+{
+  this->NodeRefs = std::move(other.NodeRefs);
+  this->NodeIndices = std::move(other.NodeIndices);
+  this->Entrances = std::move(other.Entrances);
+  this->Strings = std::move(other.Strings);
+  this->Index = std::move(other.Index);
+  this->MapBuildings = std::move(other.MapBuildings);
+  this->adopt();
+  return *this;
+}
+
+void Buildings::adopt()
+{
+  for (Building& B : this->MapBuildings)
+  {
+    B.Owner = this;
+  }
+}
+
+//
+// add / addNodeID / addString
+//
+uint32_t Buildings::addString(string_view s)
+{
+  vector<char>& strings = this->Strings.edit();
+  uint32_t offset = (uint32_t) strings.size();
+
+  strings.insert(strings.end(), s.begin(), s.end());
+  return offset;
+}
+
+void Buildings::add(long long id, string_view name, string_view streetAddr)
+{
+  Building building(id, this);
+
+  building.NameOffset = this->addString(name);
+  building.NameLength = (uint32_t) name.size();
+  building.AddressOffset = this->addString(streetAddr);
+  building.AddressLength = (uint32_t) streetAddr.size();
+  building.FirstNodeID = (uint32_t) this->NodeRefs.size();
+
+  this->MapBuildings.push_back(building);
+}
+
+void Buildings::addNodeID(long long nodeid)
+{
+  Building& building = this->MapBuildings.back();
+
+  this->NodeRefs.edit().push_back(nodeid);
+  building.NumNodeIDs++;
+  building.NodesResolved = false;
+
+  if (this->Index.size() > 0)
+  {
+    this->Index.clear();  // until resolveNodes
+  }
+}
+
+void Buildings::reserve(size_t n)
+{
+  this->MapBuildings.reserve(n);
+}
+
+//
+// addStored: the building's name, address and node IDs are already in
+// the arrays, e.g. borrowed from a snapshot, at the given ranges
+//
+void Buildings::addStored(long long id, uint32_t nameOffset, uint32_t nameLength,
+                          uint32_t addressOffset, uint32_t addressLength,
+                          uint32_t firstNodeID, uint32_t numNodeIDs)
+{
+  Building building(id, this);
+
+  building.NameOffset = nameOffset;
+  building.NameLength = nameLength;
+  building.AddressOffset = addressOffset;
+  building.AddressLength = addressLength;
+  building.FirstNodeID = firstNodeID;
+  building.NumNodeIDs = numNodeIDs;
+
+  this->MapBuildings.push_back(building);
+  this->Index.clear();  // until resolveNodes
+}
+
+//
+// append: the other collection's arrays are appended to this one's,
+// and its buildings' offsets shifted to match
+//
+void Buildings::append(const Buildings& other)
+{
+  uint32_t nodeShift = (uint32_t) this->NodeRefs.size();
+  uint32_t stringShift = (uint32_t) this->Strings.size();
+
+  this->Index.clear();  // until resolveNodes
+
+  vector<long long>& refs = this->NodeRefs.edit();
+  vector<char>& strings = this->Strings.edit();
+
+  refs.insert(refs.end(), other.NodeRefs.begin(), other.NodeRefs.end());
+  strings.insert(strings.end(), other.Strings.begin(), other.Strings.end());
+
+  this->MapBuildings.reserve(this->MapBuildings.size() + other.MapBuildings.size());
+  for (Building B : other.MapBuildings)
+  {
+    B.Owner = this;
+    B.NameOffset += stringShift;
+    B.AddressOffset += stringShift;
+    B.FirstNodeID += nodeShift;
+    B.NumNodeIndices = 0;
+    B.NumEntrances = 0;
+    B.NodesResolved = false;
+    B.Geometry = BuildingGeometry();
+
+    this->MapBuildings.push_back(B);
+  }
+}
+
   // readMapBuildings
   //
   // Given an XML document, reads through the document and 
@@ -36,7 +190,8 @@ using namespace tinyxml2;
 
     assert(attrId != nullptr);
 
-    long long id = attrId->Int64Value();
+    long long id;
+    parseInt64(attrId->Value(), id);
 
     if (osmContainsKeyValue(way, "building", "university"))
     {
@@ -45,19 +200,19 @@ using namespace tinyxml2;
             + " "
             + osmGetKeyValue(way, "addr:street");   
 
-        Building building(id, name, streetAddr);
+        this->add(id, name, streetAddr);
         
         XMLElement* nd = way->FirstChildElement("nd");
         while (nd != nullptr)
         {
         const XMLAttribute* ndref = nd->FindAttribute("ref");
         assert(ndref != nullptr);
-        long long id = ndref->Int64Value();
-        building.add(id);
+        long long id;
+        parseInt64(ndref->Value(), id);
+        this->addNodeID(id);
         // advance to next node ref:
         nd = nd->NextSiblingElement("nd");
         }
-        this->MapBuildings.push_back(building);
     }
     way = way->NextSiblingElement("way");
     }
@@ -94,16 +249,135 @@ using namespace tinyxml2;
       cout << "No such building" << endl;
     }     
   }
+  //
+  // resolveNodes: each thread resolves a contiguous range of the
+  // buildings, writing node indices at the buildings' own offsets,
+  // and collects its own entrances and dangling count; the entrances
+  // are then joined in building order
+  //
+  long long Buildings::resolveNodes(const Nodes& nodes, int numThreads)
+  {
+    size_t n = this->MapBuildings.size();
+    int numParts = (int) min((size_t) max(numThreads, 1), max(n, (size_t) 1));
+    vector<long long> dangling(numParts, 0);
+    vector<vector<Coord>> partEntrances(numParts);
+
+    this->NodeIndices.assign(this->NodeRefs.size(), 0);
+
+    parallelFor(numParts, [&](int p) {
+      size_t begin = n * p / numParts;
+      size_t end = n * (p + 1) / numParts;
+
+      for (size_t i = begin; i < end; i++)
+      {
+        Building& B = this->MapBuildings[i];
+        dangling[p] += B.resolveNodes(nodes, this->NodeIndices.data() + B.FirstNodeID, partEntrances[p]);
+      }
+    });
+
+    this->Entrances.clear();
+
+    long long total = 0;
+    for (int p = 0; p < numParts; p++)
+    {
+      uint32_t shift = (uint32_t) this->Entrances.size();
+
+      for (size_t i = n * p / numParts; i < n * (p + 1) / numParts; i++)
+      {
+        this->MapBuildings[i].FirstEntrance += shift;
+      }
+
+      this->Entrances.insert(this->Entrances.end(), partEntrances[p].begin(), partEntrances[p].end());
+      total += dangling[p];
+    }
+
+    this->buildIndex();
+    return total;
+  }
+
+  //
+  // buildIndex indexes the box of each building that has any nodes
+  //
+  void Buildings::buildIndex()
+  {
+    vector<BoundingBox> boxes;
+    vector<uint32_t> positions;
+
+    for (size_t i = 0; i < this->MapBuildings.size(); i++)
+    {
+      const Building& B = this->MapBuildings[i];
+
+      if (B.NumNodeIndices > 0)
+      {
+        const BuildingGeometry& g = B.Geometry;
+        boxes.push_back(BoundingBox{ g.MinLat, g.MinLon, g.MaxLat, g.MaxLon });
+        positions.push_back((uint32_t) i);
+      }
+    }
+
+    this->Index.build(boxes, positions);
+  }
+
+  //
+  // findContaining: the index narrows the buildings down to those
+  // whose box holds the point, then each outline is checked
+  //
+  vector<const Building*> Buildings::findContaining(const Nodes& nodes, double lat, double lon) const
+  {
+    vector<uint32_t> candidates;
+    this->Index.search(BoundingBox{ lat, lon, lat, lon }, candidates);
+    sort(candidates.begin(), candidates.end());
+
+    vector<const Building*> found;
+    for (uint32_t i : candidates)
+    {
+      if (this->MapBuildings[i].contains(nodes, lat, lon))
+      {
+        found.push_back(&this->MapBuildings[i]);
+      }
+    }
+
+    stable_sort(found.begin(), found.end(), [](const Building* b1, const Building* b2) {
+      return b1->getGeometry().Area < b2->getGeometry().Area;
+    });
+    return found;
+  }
+
+  vector<const Building*> Buildings::findInBox(const BoundingBox& box) const
+  {
+    vector<uint32_t> positions;
+    this->Index.search(box, positions);
+    sort(positions.begin(), positions.end());
+
+    vector<const Building*> found;
+    found.reserve(positions.size());
+    for (uint32_t i : positions)
+    {
+      found.push_back(&this->MapBuildings[i]);
+    }
+    return found;
+  }
+
 //
 // accessors / getters
 //
 
-int Buildings::getNumMapBuildings() 
+int Buildings::getNumMapBuildings() const
 {
     return (int) this ->MapBuildings.size();
 } 
 
-vector<Building> Buildings::getMapBuildings() const
+ArrayView<Building> Buildings::getMapBuildings() const
+{
+    return ArrayView<Building>(this->MapBuildings);
+}
+
+size_t Buildings::getMemoryUsage() const
 {
-    return this->MapBuildings;
-}
\ No newline at end of file
+    return this->MapBuildings.capacity() * sizeof(Building)
+      + this->NodeRefs.getMemoryUsage()
+      + this->NodeIndices.capacity() * sizeof(uint32_t)
+      + this->Entrances.capacity() * sizeof(Coord)
+      + this->Strings.getMemoryUsage()
+      + this->Index.getMemoryUsage();
+}
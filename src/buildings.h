@@ -1,54 +1,136 @@
-/*buildings.h*/
-
-//
-// A collection of buildings in the Open Street Map.
-// 
-
-
-#pragma once
-
-#include <vector>
-#include <iostream>
-
-#include "building.h"
-#include "busstops.h"
-#include "tinyxml2.h"
-#include "curl_util.h"
-
-using namespace std;
-using namespace tinyxml2;
-
-
-//
-// Keeps track of all the buildings in the map.
-//
-class Buildings
-{
-
-public:
-vector<Building> MapBuildings;
-  //
-  // readMapBuildings
-  //
-  // Given an XML document, reads through the document and 
-  // stores all the buildings into the given vector.
-  //
-  void readMapBuildings(XMLDocument& xmldoc);
-  //
-  // print prints all of the existing buildings
-  //
-  void print();
-
-  //
-  // findAndPrint searches for a building and prints the buildings attributes
-  //
-  void findAndPrint(string& answer, const Nodes& nodes, BusStops& busStops, CURL* curl);
-  //
-  // accessors / getters
-  //
-  int getNumMapBuildings();
-  vector<Building> getMapBuildings() const;
-  
-};
-
-
+/*buildings.h*/
+
+//
+// A collection of buildings in the Open Street Map.
+// 
+
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <cstdint>
+#include <iostream>
+
+#include "building.h"
+#include "buildingindex.h"
+#include "column.h"
+#include "busstops.h"
+#include "tinyxml2.h"
+#include "curl_util.h"
+
+using namespace std;
+using namespace tinyxml2;
+
+
+//
+// Keeps track of all the buildings in the map.
+//
+// The buildings' variable-length data is stored flat, compressed
+// sparse row style, rather than in each Building: the node IDs of
+// all buildings in one array, building after building, each Building
+// holding the offset and count of its own; likewise the resolved
+// node indices (at the same offsets as the IDs), the entrances, and
+// the names and addresses in one string arena. Loading then makes a
+// few large allocations instead of several per building, and a scan
+// over all buildings reads memory in order. Loaded from a snapshot,
+// the node IDs and strings are borrowed from the mapped file (see
+// column.h) until buildings are added.
+//
+// resolveNodes also indexes the buildings' bounding boxes (see
+// buildingindex.h) for findContaining and findInBox. The buildings
+// are only changed through add, addNodeID and append, and the last
+// two drop the index, so those find nothing until resolveNodes is
+// called again.
+//
+class Buildings
+{
+  Column<long long> NodeRefs;
+  vector<uint32_t> NodeIndices;  // parallel to NodeRefs, once resolved
+  vector<Coord> Entrances;
+  Column<char> Strings;
+  BuildingIndex Index;  // over the resolved buildings' boxes
+  vector<Building> MapBuildings;
+
+  uint32_t addString(string_view s);
+  void addStored(long long id, uint32_t nameOffset, uint32_t nameLength,
+                 uint32_t addressOffset, uint32_t addressLength,
+                 uint32_t firstNodeID, uint32_t numNodeIDs);
+  void adopt();
+  void buildIndex();
+
+  friend class Building;
+  friend class Snapshot;  // borrows the node IDs and strings
+
+public:
+  Buildings();
+  Buildings(const Buildings& other);
+  Buildings(Buildings&& other);
+  Buildings& operator=(const Buildings& other);
+  Buildings& operator=(Buildings&& other);
+
+  //
+  // readMapBuildings
+  //
+  // Given an XML document, reads through the document and 
+  // stores all the buildings into the given vector.
+  //
+  void readMapBuildings(XMLDocument& xmldoc);
+  //
+  // add adds a building with no nodes to the end of the collection;
+  // addNodeID adds a node ID to the end of the last building's.
+  //
+  void add(long long id, string_view name, string_view streetAddr);
+  void addNodeID(long long nodeid);
+  //
+  // reserve makes room for n buildings in all
+  //
+  void reserve(size_t n);
+  //
+  // append adds all of the other collection's buildings to the end
+  // of this one (unresolved).
+  //
+  void append(const Buildings& other);
+  //
+  // print prints all of the existing buildings
+  //
+  void print();
+
+  //
+  // findAndPrint searches for a building and prints the buildings attributes
+  //
+  void findAndPrint(string& answer, const Nodes& nodes, BusStops& busStops, CURL* curl);
+  //
+  // resolveNodes resolves every building's node IDs to indices into
+  // the given nodes and computes its geometry (see
+  // Building::resolveNodes), splitting the buildings over up to
+  // numThreads threads. Returns the number of node IDs that were not
+  // found.
+  //
+  long long resolveNodes(const Nodes& nodes, int numThreads);
+  //
+  // findContaining returns the buildings whose outline contains (lat,
+  // lon), smallest area first (e.g. a building inside a courtyard
+  // before the one around it)
+  //
+  vector<const Building*> findContaining(const Nodes& nodes, double lat, double lon) const;
+  //
+  // findInBox returns the buildings whose bounding box intersects the
+  // given one (e.g. a map viewport), in map order
+  //
+  vector<const Building*> findInBox(const BoundingBox& box) const;
+  //
+  // accessors / getters: getMapBuildings is a view of the buildings,
+  // valid until buildings are added
+  //
+  int getNumMapBuildings() const;
+  ArrayView<Building> getMapBuildings() const;
+  //
+  // getMemoryUsage returns the bytes used by the buildings and their
+  // arrays (capacity, not just size).
+  //
+  size_t getMemoryUsage() const;
+  
+};
@@ -18,13 +18,13 @@ using namespace std;
 //
 BusStop::BusStop() 
     : ID("Unknown"), Route("Unknown"), Name("Unknown"), Direction("Unknown"), Location("Unknown"), 
-      Lat(0.0), Lon(0.0), Distance(numeric_limits<double>::max()) {}
+      Lat(0), Lon(0), Distance(numeric_limits<double>::max()) {}
 //
 // constructor
 //
 BusStop::BusStop(string id_str, string route_str, string stopname, string direction, string location, 
 double lat_str, double lon_str)
-    : ID(id_str), Route(route_str), Name(stopname), Direction(direction), Location(location), Lat(lat_str), Lon(lon_str)
+    : ID(id_str), Route(route_str), Name(stopname), Direction(direction), Location(location), Lat(toFixedCoord(lat_str)), Lon(toFixedCoord(lon_str))
     {}
 //
 // Prints information about the stop
@@ -79,7 +79,7 @@ void BusStop::setDistance(double distance){
 }
 // accessors
 //
-double BusStop::getDistance()
+double BusStop::getDistance() const
 {
     return Distance;
 }
@@ -87,32 +87,36 @@ double BusStop::getDistance()
 // accesors
 //
 
-string BusStop::getID()
+string_view BusStop::getID() const
 {
     return ID;
 }
 
-string BusStop::getStreet()
+string_view BusStop::getStreet() const
 {
     return Route;
 }
-string BusStop::getName()
+string_view BusStop::getRoute() const
+{
+    return Route;
+}
+string_view BusStop::getName() const
 {
     return Name;
 }
-string BusStop::getDirection()
+string_view BusStop::getDirection() const
 {
     return Direction;
 }
-string BusStop::getLocation()
+string_view BusStop::getLocation() const
 {
     return Location;
 }
-double BusStop::getLat()
+double BusStop::getLat() const
 {
-    return Lat;
+    return fromFixedCoord(Lat);
 }
-double BusStop::getLon()
+double BusStop::getLon() const
 {
-    return Lon;
+    return fromFixedCoord(Lon);
 }
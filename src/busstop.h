@@ -3,9 +3,11 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <iostream>
 #include "curl_util.h"
+#include "coord.h"
 #include <limits>
 
 
@@ -19,8 +21,8 @@ string Route;
 string Name;
 string Direction;
 string Location;
-double Lat;
-double Lon;
+int32_t Lat;  // fixed-point, see coord.h
+int32_t Lon;
 double Distance;
 
 public:
@@ -36,16 +38,17 @@ double lat_str, double lon_str);
 void print(CURL* curl);
 
 void setDistance(double distance);
-// accessors
+// accessors (the string views are valid as long as the stop)
 //
-double getDistance();
-string getID();
-string getStreet();
-string getName();
-string getDirection();
-string getLocation();
-double getLat();
-double getLon();
+double getDistance() const;
+string_view getID() const;
+string_view getStreet() const;
+string_view getRoute() const;
+string_view getName() const;
+string_view getDirection() const;
+string_view getLocation() const;
+double getLat() const;
+double getLon() const;
 
 
 };
\ No newline at end of file
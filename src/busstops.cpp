@@ -10,18 +10,27 @@
 #include <sstream>
 #include <vector>
 #include <algorithm>
+#include <functional>
 #include "dist.h"
+#include "parallel.h"
 #include <limits>
 
 
 using namespace std;
 
+//
+// default constructor: no stops (e.g. filled from a snapshot)
+//
+BusStops::BusStops()
+    : Filename(""), Indexed(true)
+    {}
+
 //
 // constructor which given a filename takes the information of the busstops and creates a 
 // busstop object to store the information
 //
 BusStops::BusStops(string filename)
-    : Filename(filename)
+    : Filename(filename), Indexed(true)
     {
         ifstream infile;
         string line;
@@ -54,18 +63,71 @@ BusStops::BusStops(string filename)
         }
         infile.close();
         
-        
+        this->buildIndex();
     };
+
+//
+// buildIndex builds one index per direction, over the positions of
+// the stops going that way
+//
+void BusStops::buildIndex()
+{
+    map<string, vector<uint32_t>> positions;
+
+    for (size_t i = 0; i < MapStops.size(); i++)
+    {
+        positions[string(MapStops[i].getDirection())].push_back((uint32_t) i);
+    }
+
+    vector<uint32_t> all(MapStops.size());
+    for (size_t i = 0; i < all.size(); i++)
+    {
+        all[i] = (uint32_t) i;
+    }
+    this->AllStopsIndex.build(MapStops, all);
+
+    this->DirectionIndexes.clear();
+    for (auto& [direction, stops] : positions)
+    {
+        this->DirectionIndexes[direction].build(MapStops, stops);
+    }
+
+    this->Indexed = true;
+}
+
+//
+// add appends a stop; the indexes are rebuilt before the next query
+//
+void BusStops::add(BusStop stop)
+{
+    MapStops.push_back(std::move(stop));
+    this->Indexed = false;
+}
+
+void BusStops::reserve(size_t n)
+{
+    MapStops.reserve(n);
+}
   //
   // print prints all of the existing busstops
   //
 void BusStops::print()
 {
-    sort(MapStops.begin(), MapStops.end(),
-    [](BusStop& b1, BusStop& b2) { return b1.getID() < b2.getID(); } );
+    //
+    // sort positions rather than the stops, which the indexes refer to
+    //
+    vector<size_t> order(MapStops.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
 
-    for (BusStop& B: MapStops)
+    stable_sort(order.begin(), order.end(),
+    [this](size_t i1, size_t i2) { return MapStops[i1].getID() < MapStops[i2].getID(); } );
+
+    for (size_t i : order)
     {
+        const BusStop& B = MapStops[i];
         cout << B.getID() << ": bus " << B.getStreet()  << ", " << B.getName() << ", " << B.getDirection() << ", ";
         cout << B.getLocation() << ", location (" << B.getLat() << ", " << B.getLon() << ")" << endl;
     }
@@ -77,25 +139,146 @@ pair<BusStop, BusStop> BusStops::closestStops(double Lat, double Lon)
 {
     BusStop NorthBound;
     BusStop SouthBound;
-    
-    double distanceNorth = numeric_limits<double>::max();
-    double distanceSouth = numeric_limits<double>::max();
-
-    for (BusStop& B : MapStops){
-       double distance = distBetween2Points(Lat, Lon, B.getLat(), B.getLon());
-
-       B.setDistance(distance);
-       
-       if (B.getDirection() == "Northbound" && distance < distanceNorth)
-       {
-        NorthBound = B;
-        distanceNorth = distance;
-       }
-       if (B.getDirection() == "Southbound" && distance < distanceSouth){
-        SouthBound = B;
-        distanceSouth = distance;
-       }
+    size_t position;
+    double distance;
+
+    if (this->nearest("Northbound", Lat, Lon, position, distance))
+    {
+        NorthBound = MapStops[position];
+        NorthBound.setDistance(distance);
+    }
+    if (this->nearest("Southbound", Lat, Lon, position, distance))
+    {
+        SouthBound = MapStops[position];
+        SouthBound.setDistance(distance);
     }
     return make_pair(NorthBound, SouthBound);
     }
+
+//
+// nearest finds the closest stop going in the given direction,
+// returning false if there is none
+//
+bool BusStops::nearest(const string& direction, double Lat, double Lon, size_t& position, double& distance)
+{
+    this->ensureIndexed();
+
+    auto it = this->DirectionIndexes.find(direction);
+    if (it == this->DirectionIndexes.end())
+    {
+        return false;
+    }
+
+    return it->second.nearest(Lat, Lon, position, distance);
+}
+
+vector<NearbyStop> BusStops::nearestStops(double Lat, double Lon, size_t k, double radius,
+                                          const StopFilter& filter)
+{
+    this->ensureIndexed();
+    return this->findNearest(Lat, Lon, k, radius, filter);
+}
+
+//
+// nearestStopsBatch: each thread takes an equal run of the points;
+// the indexes are only read, so the threads share them
+//
+vector<vector<NearbyStop>> BusStops::nearestStopsBatch(const vector<pair<double, double>>& points, size_t k,
+                                                       double radius, const StopFilter& filter, int numThreads)
+{
+    this->ensureIndexed();
+
+    vector<vector<NearbyStop>> results(points.size());
+
+    //
+    // not worth a thread for fewer than a few hundred points:
+    //
+    const size_t MIN_POINTS = 256;
+    int numParts = (int) min((size_t) max(1, numThreads), max((size_t) 1, points.size() / MIN_POINTS));
+
+    parallelFor(numParts, [&](int p) {
+        size_t begin = points.size() * p / numParts;
+        size_t end = points.size() * (p + 1) / numParts;
+
+        for (size_t i = begin; i < end; i++)
+        {
+            results[i] = this->findNearest(points[i].first, points[i].second, k, radius, filter);
+        }
+    });
+
+    return results;
+}
+
+//
+// findNearest searches the index of each direction asked for, or of
+// all stops if any direction will do, checking routes as it goes
+//
+vector<NearbyStop> BusStops::findNearest(double Lat, double Lon, size_t k, double radius,
+                                         const StopFilter& filter) const
+{
+    function<bool(size_t)> onRoute;
+    if (!filter.Routes.empty())
+    {
+        onRoute = [this, &filter](size_t position) {
+            string_view route = MapStops[position].getRoute();
+            return find(filter.Routes.begin(), filter.Routes.end(), route) != filter.Routes.end();
+        };
+    }
+
+    vector<StopMatch> matches;
+
+    if (filter.Directions.empty())
+    {
+        this->AllStopsIndex.nearest(Lat, Lon, k, radius, onRoute, matches);
+    }
+    else
+    {
+        vector<string> directions = filter.Directions;
+        sort(directions.begin(), directions.end());
+        directions.erase(unique(directions.begin(), directions.end()), directions.end());
+
+        for (const string& direction : directions)
+        {
+            auto it = this->DirectionIndexes.find(direction);
+            if (it == this->DirectionIndexes.end())
+            {
+                continue;
+            }
+
+            vector<StopMatch> found;
+            it->second.nearest(Lat, Lon, k, radius, onRoute, found);
+            matches.insert(matches.end(), found.begin(), found.end());
+        }
+
+        sort(matches.begin(), matches.end());
+        if (matches.size() > k)
+        {
+            matches.resize(k);
+        }
+    }
+
+    vector<NearbyStop> stops;
+    stops.reserve(matches.size());
+    for (const StopMatch& match : matches)
+    {
+        stops.push_back(NearbyStop{ &MapStops[match.Position], match.Distance });
+    }
+    return stops;
+}
+
+//
+// ensureIndexed re-indexes if stops were added since the last build
+//
+void BusStops::ensureIndexed()
+{
+    if (!this->Indexed)
+    {
+        this->buildIndex();
+    }
+}
+
+ArrayView<BusStop> BusStops::getMapStops() const
+{
+    return ArrayView<BusStop>(this->MapStops);
+}
     
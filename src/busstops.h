@@ -4,26 +4,103 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include <iostream>
+#include "arrayview.h"
 #include "busstop.h"
+#include "stopindex.h"
 #include <limits>
 
 
 using namespace std;
 
+//
+// StopFilter
+//
+// Which stops BusStops::nearestStops may return: those on any of the
+// Routes and going any of the Directions (e.g. "Northbound"). An
+// empty list allows any.
+//
+struct StopFilter
+{
+    vector<string> Routes;
+    vector<string> Directions;
+};
+
+//
+// NearbyStop
+//
+// A stop found by BusStops::nearestStops, and its distance in miles.
+// The pointer is valid until stops are added.
+//
+struct NearbyStop
+{
+    const BusStop* Stop;
+    double Distance;
+};
+
+//
+// The bus stops, with spatial indexes (see stopindex.h), over all of
+// them and over each direction's, so the closest stops are found
+// without measuring the distance to every stop.
+//
 class BusStops
 {
     string Filename;
-    public:
     vector<BusStop> MapStops;
+    StopIndex AllStopsIndex;
+    map<string, StopIndex> DirectionIndexes;  // by stop direction
+    bool Indexed;                             // false once stops are added
 
+    void ensureIndexed();
+    vector<NearbyStop> findNearest(double Lat, double Lon, size_t k, double radius,
+                                   const StopFilter& filter) const;
+
+    bool nearest(const string& direction, double Lat, double Lon, size_t& position, double& distance);
+
+    public:
+    //
+    // constructors: an empty collection, or one read from a
+    // comma-separated bus stop file
+    //
+    BusStops();
     BusStops(string Filename);
     //
-    // print prints all of the existing busstops
+    // add appends a stop, leaving the indexes to be rebuilt; reserve
+    // makes room for n stops in all. Stops are only changed through
+    // add, so the indexes never see a stop other than as added.
+    //
+    void add(BusStop stop);
+    void reserve(size_t n);
+    //
+    // buildIndex indexes the stops; call it after adding stops (the
+    // file constructor does, as does loading a snapshot). The queries
+    // re-index by themselves if stops were added since.
+    //
+    void buildIndex();
+    //
+    // print prints all of the existing busstops, in order of ID
     //
     void print();
     //
     //closestStops find the closest stops to a given buildings
     //
     pair<BusStop, BusStop> closestStops(double Lat, double Lon);
+    //
+    // nearestStops finds the up to k stops closest to (Lat, Lon),
+    // within radius miles, that pass the filter, nearest first (ties
+    // in the order the stops were added)
+    //
+    vector<NearbyStop> nearestStops(double Lat, double Lon, size_t k, double radius,
+                                    const StopFilter& filter);
+    //
+    // nearestStopsBatch is nearestStops for each of the (lat, lon)
+    // points, in order, the points split over up to numThreads threads
+    //
+    vector<vector<NearbyStop>> nearestStopsBatch(const vector<pair<double, double>>& points, size_t k,
+                                                 double radius, const StopFilter& filter, int numThreads);
+    //
+    // getMapStops is a view of the stops, valid until stops are added
+    //
+    ArrayView<BusStop> getMapStops() const;
 };
\ No newline at end of file
@@ -0,0 +1,95 @@
+/*column.h*/
+
+//
+// An array that is either owned or borrowed from a snapshot mapping.
+//
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+#include "arrayview.h"
+
+using namespace std;
+
+
+//
+// Column
+//
+// An array of T that is either owned (a vector) or borrowed, read-only,
+// from memory kept alive by a shared owner, e.g. a snapshot file
+// mapped into memory (see snapshot.h): a borrowed column costs the
+// process nothing beyond the mapping, whose pages the page cache shares
+// with every other process that maps the file.
+//
+// Reads work the same either way. Changing a column goes through
+// edit, which first copies a borrowed column into a vector of its own,
+// so the mapping is never written to.
+//
+template <typename T>
+class Column
+{
+private:
+  vector<T> Owned;
+  const T* Borrowed;     // nullptr unless borrowed
+  size_t BorrowedCount;
+  shared_ptr<const void> Keeper;  // keeps the borrowed memory alive
+
+public:
+  Column()
+    : Borrowed(nullptr), BorrowedCount(0)
+  {
+  }
+
+  //
+  // borrow
+  //
+  // Drops the column's contents and reads the count elements at data
+  // instead, holding on to keeper for as long as it does.
+  //
+  void borrow(const T* data, size_t count, shared_ptr<const void> keeper)
+  {
+    this->Owned = vector<T>();
+    this->Borrowed = data;
+    this->BorrowedCount = count;
+    this->Keeper = std::move(keeper);
+  }
+
+  //
+  // edit
+  //
+  // The column as a vector to change, copied out of the borrowed
+  // memory first if need be.
+  //
+  vector<T>& edit()
+  {
+    if (this->Borrowed != nullptr)
+    {
+      this->Owned.assign(this->Borrowed, this->Borrowed + this->BorrowedCount);
+      this->Borrowed = nullptr;
+      this->BorrowedCount = 0;
+      this->Keeper.reset();
+    }
+
+    return this->Owned;
+  }
+
+  bool isBorrowed() const { return this->Borrowed != nullptr; }
+
+  const T* data() const { return this->Borrowed != nullptr ? this->Borrowed : this->Owned.data(); }
+  size_t size() const { return this->Borrowed != nullptr ? this->BorrowedCount : this->Owned.size(); }
+  bool empty() const { return this->size() == 0; }
+  const T* begin() const { return this->data(); }
+  const T* end() const { return this->data() + this->size(); }
+  const T& operator[](size_t i) const { return this->data()[i]; }
+  ArrayView<T> view() const { return ArrayView<T>(this->data(), this->size()); }
+
+  //
+  // getMemoryUsage
+  //
+  // Bytes the column owns (its capacity); a borrowed column owns none.
+  //
+  size_t getMemoryUsage() const { return this->Owned.capacity() * sizeof(T); }
+};
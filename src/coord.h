@@ -0,0 +1,85 @@
+/*coord.h*/
+
+//
+// Fixed-point coordinates.
+//
+// OSM records positions to 7 decimal places (1e-7 degree, about 1 cm),
+// so a latitude or longitude fits exactly in an int32 counting 1e-7
+// degree units: +-180 degrees is +-1.8e9 units, inside int32's
+// +-2.1e9. Nodes, buildings and bus stops store their coordinates
+// this way, in half the space of doubles, and convert to degrees only
+// where a computation (a distance, a center) needs them.
+//
+// The conversion back is exact for the decimals OSM writes: units /
+// 10^7 is one correctly rounded division of two exact doubles, which
+// gives the same double as parsing the decimal text did.
+//
+// The precision is configurable at compile time with COORD_DECIMALS
+// (e.g. -DCOORD_DECIMALS=6 for 1e-6 degree units); 7 is the most an
+// int32 can hold.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+
+using namespace std;
+
+
+#ifndef COORD_DECIMALS
+#define COORD_DECIMALS 7
+#endif
+
+static_assert(COORD_DECIMALS >= 0 && COORD_DECIMALS <= 7,
+              "an int32 holds +-180 degrees to at most 7 decimal places");
+
+
+//
+// COORD_UNITS_PER_DEGREE
+//
+// 10^COORD_DECIMALS.
+//
+constexpr double coordUnitsPerDegree(int decimals)
+{
+  return decimals == 0 ? 1.0 : 10.0 * coordUnitsPerDegree(decimals - 1);
+}
+
+constexpr double COORD_UNITS_PER_DEGREE = coordUnitsPerDegree(COORD_DECIMALS);
+
+
+//
+// toFixedCoord / fromFixedCoord
+//
+// Degrees to the nearest fixed-point unit, and back. Degrees must be
+// within +-180.
+//
+inline int32_t toFixedCoord(double degrees)
+{
+  return (int32_t) lround(degrees * COORD_UNITS_PER_DEGREE);
+}
+
+inline double fromFixedCoord(int32_t units)
+{
+  return units / COORD_UNITS_PER_DEGREE;
+}
+
+
+//
+// Coord
+//
+// A fixed-point (lat, lon) position.
+//
+struct Coord
+{
+  int32_t Lat;
+  int32_t Lon;
+
+  static Coord fromDegrees(double lat, double lon)
+  {
+    return Coord{ toFixedCoord(lat), toFixedCoord(lon) };
+  }
+
+  double getLat() const { return fromFixedCoord(this->Lat); }
+  double getLon() const { return fromFixedCoord(this->Lon); }
+};
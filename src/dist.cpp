@@ -1,52 +1,185 @@
-/*dist.cpp*/
-
-//
-// Computes the distance between 2 positions, given in
-// (latitude, longitude) coordinates.
-// 
-
-
-#include <iostream>
-#include <cmath>
-
-#include "dist.h"
-
-using namespace std;
-
-
-//
-// DistBetween2Points
-//
-// Returns the distance in miles between 2 points (lat1, long1) and 
-// (lat2, long2). Latitudes are positive above the equator and 
-// negative below; longitudes are positive heading east of Greenwich 
-// and negative heading west. Example: Chicago is (41.88, -87.63).
-//
-// Reference: chatGPT using haversine formula
-//
-// static constexpr double M_PI = 3.141592653589;
-
-static double toRadians(double degrees)
-{
-  return (degrees * 3.141592653589 / 180.0);
-}
-
-double distBetween2Points(double lat1, double lon1, double lat2, double lon2)
-{
-  const double R = 6371; // Earth's radius in kilometers
-
-  double dLat = toRadians(lat2 - lat1);
-  double dLon = toRadians(lon2 - lon1);
-
-  double a = sin(dLat / 2) * sin(dLat / 2) +
-    cos(toRadians(lat1)) * cos(toRadians(lat2)) *
-    sin(dLon / 2) * sin(dLon / 2);
-
-  double c = 2 * atan2(sqrt(a), sqrt(1 - a));
-
-  double dist_in_km = R * c;
-
-  double dist_in_miles = dist_in_km * 0.6213711922;
-
-  return dist_in_miles;
-}
+/*dist.cpp*/
+
+//
+// Computes the distance between 2 positions, given in
+// (latitude, longitude) coordinates.
+// 
+
+
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define DIST_HAVE_AVX2 1
+#endif
+
+#include "dist.h"
+
+using namespace std;
+
+
+//
+// DistBetween2Points
+//
+// Returns the distance in miles between 2 points (lat1, long1) and 
+// (lat2, long2). Latitudes are positive above the equator and 
+// negative below; longitudes are positive heading east of Greenwich 
+// and negative heading west. Example: Chicago is (41.88, -87.63).
+//
+// Reference: chatGPT using haversine formula
+//
+// static constexpr double M_PI = 3.141592653589;
+
+static double toRadians(double degrees)
+{
+  return (degrees * 3.141592653589 / 180.0);
+}
+
+static const double EARTH_RADIUS_KM = 6371;  // Earth's radius
+static const double MILES_PER_KM = 0.6213711922;
+
+double distBetween2Points(double lat1, double lon1, double lat2, double lon2)
+{
+  return DistanceFrom(lat1, lon1).exact(lat2, lon2);
+}
+
+
+//
+// DistanceFrom: the haversine formula, with the query's cosine
+// computed ahead
+//
+DistanceFrom::DistanceFrom(double lat, double lon)
+  : Lat(lat), Lon(lon), CosLat(cos(toRadians(lat)))
+{
+}
+
+double DistanceFrom::exact(double lat, double lon) const
+{
+  double dLat = toRadians(lat - this->Lat);
+  double dLon = toRadians(lon - this->Lon);
+
+  double sinLat = sin(dLat / 2);
+  double sinLon = sin(dLon / 2);
+
+  double a = sinLat * sinLat +
+    this->CosLat * cos(toRadians(lat)) *
+    sinLon * sinLon;
+
+  double c = 2 * atan2(sqrt(a), sqrt(1 - a));
+
+  return EARTH_RADIUS_KM * c * MILES_PER_KM;
+}
+
+//
+// chordSquaredToMiles / milesToChordSquared: the angle between two
+// points whose chord is c is 2 asin(c / 2), which is about c
+//
+double chordSquaredToMiles(double chordSquared)
+{
+  return EARTH_RADIUS_KM * sqrt(chordSquared) * MILES_PER_KM;
+}
+
+double milesToChordSquared(double miles)
+{
+  double angle = miles / MILES_PER_KM / EARTH_RADIUS_KM;
+  double chord = 2.0 * sin(min(angle, M_PI) / 2.0);
+
+  return chord * chord;
+}
+
+
+//
+// chordsSquared
+//
+// The scalar kernel, and the AVX2 kernel (compiled for AVX2 whatever
+// the build flags, and only called if the CPU has it). Both leave any
+// n % 4 tail to the scalar loop.
+//
+static void chordsSquaredScalar(double x, double y, double z,
+                                const double* xs, const double* ys, const double* zs, size_t n, double* out)
+{
+  for (size_t i = 0; i < n; i++)
+  {
+    double dx = xs[i] - x;
+    double dy = ys[i] - y;
+    double dz = zs[i] - z;
+
+    out[i] = dx * dx + dy * dy + dz * dz;
+  }
+}
+
+#ifdef DIST_HAVE_AVX2
+__attribute__((target("avx2,fma")))
+static void chordsSquaredAVX2(double x, double y, double z,
+                              const double* xs, const double* ys, const double* zs, size_t n, double* out)
+{
+  __m256d qx = _mm256_set1_pd(x);
+  __m256d qy = _mm256_set1_pd(y);
+  __m256d qz = _mm256_set1_pd(z);
+
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(xs + i), qx);
+    __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(ys + i), qy);
+    __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(zs + i), qz);
+
+    __m256d sum = _mm256_mul_pd(dx, dx);
+    sum = _mm256_fmadd_pd(dy, dy, sum);
+    sum = _mm256_fmadd_pd(dz, dz, sum);
+
+    _mm256_storeu_pd(out + i, sum);
+  }
+
+  chordsSquaredScalar(x, y, z, xs + i, ys + i, zs + i, n - i, out + i);
+}
+#endif
+
+static bool cpuHasAVX2()
+{
+#ifdef DIST_HAVE_AVX2
+  __builtin_cpu_init();  // may run before main, from Kernel's initializer
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+  return false;
+#endif
+}
+
+static DistanceKernel Kernel = cpuHasAVX2() ? DistanceKernel::AVX2 : DistanceKernel::SCALAR;
+
+void chordsSquared(double x, double y, double z,
+                   const double* xs, const double* ys, const double* zs, size_t n, double* out)
+{
+#ifdef DIST_HAVE_AVX2
+  if (Kernel == DistanceKernel::AVX2)
+  {
+    chordsSquaredAVX2(x, y, z, xs, ys, zs, n, out);
+    return;
+  }
+#endif
+
+  chordsSquaredScalar(x, y, z, xs, ys, zs, n, out);
+}
+
+DistanceKernel getDistanceKernel()
+{
+  return Kernel;
+}
+
+bool setDistanceKernel(DistanceKernel kernel)
+{
+  if (kernel == DistanceKernel::AVX2 && !cpuHasAVX2())
+  {
+    return false;
+  }
+
+  Kernel = kernel;
+  return true;
+}
+
+const char* distanceKernelName(DistanceKernel kernel)
+{
+  return kernel == DistanceKernel::AVX2 ? "avx2" : "scalar";
+}
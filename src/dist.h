@@ -1,23 +1,111 @@
-/*dist.h*/
-
-//
-// Computes the distance between 2 positions, given in
-// (latitude, longitude) coordinates.
-// 
-
-
-#pragma once
-
-
-//
-// DistBetween2Points
-//
-// Returns the distance in miles between 2 points (lat1, long1) and 
-// (lat2, long2). Latitudes are positive above the equator and 
-// negative below; longitudes are positive heading east of Greenwich 
-// and negative heading west. Example: Chicago is (41.88, -87.63).
-//
-// Reference: chatGPT using haversine formula
-//
-double distBetween2Points(double lat1, double lon1, double lat2, double lon2);
-
+/*dist.h*/
+
+//
+// Computes the distance between 2 positions, given in
+// (latitude, longitude) coordinates.
+// 
+
+
+#pragma once
+
+#include <cstddef>
+
+
+//
+// DistBetween2Points
+//
+// Returns the distance in miles between 2 points (lat1, long1) and 
+// (lat2, long2). Latitudes are positive above the equator and 
+// negative below; longitudes are positive heading east of Greenwich 
+// and negative heading west. Example: Chicago is (41.88, -87.63).
+//
+// Reference: chatGPT using haversine formula
+//
+double distBetween2Points(double lat1, double lon1, double lat2, double lon2);
+
+//
+// DistanceFrom
+//
+// Distances in miles from one point (a query) to many others, the
+// query's trigonometry done once rather than for every other point.
+// (distBetween2Points(lat1, lon1, lat2, lon2) is DistanceFrom(lat1,
+// lon1).exact(lat2, lon2).)
+//
+class DistanceFrom
+{
+  double Lat, Lon;
+  double CosLat;
+
+public:
+  DistanceFrom(double lat, double lon);
+
+  double exact(double lat, double lon) const;
+};
+
+
+
+//
+// DistanceKernel
+//
+// How chordsSquared does its arithmetic: four stops at a time with
+// AVX2 (and FMA) instructions, or one at a time. AVX2 is used when the
+// CPU has it.
+//
+enum class DistanceKernel
+{
+  SCALAR,
+  AVX2
+};
+
+//
+// chordsSquared
+//
+// Given a point (x, y, z) on the unit sphere, computes the squared
+// straight-line distance from it to each of the n points (xs[i],
+// ys[i], zs[i]), also on the unit sphere, into out[i].
+//
+// This is 4 times the haversine term "a" of distBetween2Points, with
+// the trigonometry done once per point ahead of time instead of for
+// every pair, and it grows with the distance between the points, so
+// it can rank and rule out many points at once for the price of a few
+// multiplications each. (The distance itself is 2 R asin(sqrt(out[i])
+// / 2).)
+//
+void chordsSquared(double x, double y, double z,
+                   const double* xs, const double* ys, const double* zs, size_t n, double* out);
+
+//
+// getDistanceKernel / setDistanceKernel
+//
+// The kernel chordsSquared uses. setDistanceKernel returns false (and
+// changes nothing) if the CPU does not support the kernel asked for.
+//
+DistanceKernel getDistanceKernel();
+bool setDistanceKernel(DistanceKernel kernel);
+const char* distanceKernelName(DistanceKernel kernel);
+
+//
+// chordSquaredToMiles / milesToChordSquared
+//
+// Convert between a squared chord on the unit sphere (see
+// chordsSquared) and miles along the Earth.
+//
+// chordSquaredToMiles is the cheap, approximate direction: R * chord,
+// a square root and no trigonometry. It understates the distance d by
+// up to a fraction (d / R)^2 / 24, R = 3959 miles:
+//
+//   campus (1 mile):      under 3 in 10^9, 0.0002 inch
+//   city (30 miles):      under 3 in 10^6, 5 inches
+//   region (300 miles):   under 3 in 10^4, 400 feet
+//
+// give or take rounding, under 10^-7 feet (see bench/dist_bench.cpp).
+// The chords are in the same order as the distances, up to that
+// rounding, so ranking by chord and measuring only the winners (and
+// any within rounding of them) with distBetween2Points gives the
+// exact answer.
+//
+// milesToChordSquared is the exact inverse of distBetween2Points's
+// distance, for turning a radius into a bound on the chord.
+//
+double chordSquaredToMiles(double chordSquared);
+double milesToChordSquared(double miles);
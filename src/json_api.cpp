@@ -9,12 +9,20 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <limits>
 #include <sstream>
+#include <algorithm>
 #include "json.hpp"
 #include "nodes.h"
 #include "buildings.h"
 #include "busstops.h"
+#include "dist.h"
 #include "osm.h"
+#include "maploader.h"
+#include "parallel.h"
+#include "snapshot.h"
 #include "tinyxml2.h"
 
 using json = nlohmann::json;
@@ -25,6 +33,40 @@ Nodes nodes;
 Buildings buildings;
 BusStops* busStops = nullptr;
 bool dataLoaded = false;
+LoadReport loadReport;
+int loadThreads = defaultThreadCount();
+string osmFile = "data/nu.osm";
+
+// Load nodes, buildings and bus stops from a binary snapshot. The node
+// columns, node refs and strings are served from the mapped file (see
+// snapshot.h), which stays mapped for as long as they are in use.
+bool loadSnapshot(const string& snapshotFile) {
+    if (dataLoaded) {
+        return true;
+    }
+
+    Snapshot snapshot;
+
+    loadReport.startPhase();
+    if (!snapshot.open(snapshotFile)) {
+        cerr << "Error: Could not load snapshot file" << endl;
+        return false;
+    }
+    loadReport.endPhase("snapshot map");
+
+    busStops = new BusStops();
+    snapshot.load(nodes, buildings, *busStops);
+    loadReport.endPhase("snapshot load");
+
+    loadReport.NumDanglingRefs = buildings.resolveNodes(nodes, loadThreads);
+    loadReport.endPhase("resolve refs");
+
+    loadReport.NumNodes = nodes.getNumMapNodes();
+    loadReport.NumBuildings = buildings.getNumMapBuildings();
+
+    dataLoaded = true;
+    return true;
+}
 
 // Load OSM data and bus stops
 bool loadData() {
@@ -32,80 +74,75 @@ bool loadData() {
         return true;
     }
 
-    string osmFile = "data/nu.osm";
     string busStopsFile = "data/bus-stops.txt";
-    XMLDocument document;
 
-    // Load OSM file
-    if (!osmLoadMapFile(osmFile, document)) {
+    // Stream nodes and buildings out of the OSM file (XML or PBF) in
+    // one pass, split across threads if there is more than one
+    MapLoader loader(nodes, buildings, loadReport);
+    bool loaded = loader.load(osmFile, loadThreads);
+
+    if (!loaded) {
         cerr << "Error: Could not load OSM file" << endl;
         return false;
     }
 
-    // Parse nodes and buildings
-    nodes.readMapNodes(document);
-    buildings.readMapBuildings(document);
-
     // Load bus stops
+    loadReport.startPhase();
     busStops = new BusStops(busStopsFile);
+    loadReport.endPhase("bus stops");
 
     dataLoaded = true;
     return true;
 }
 
+// One building's fields, as the building list commands return them
+json buildingToJson(const Building& b) {
+    auto location = b.getLocation(nodes);
+
+    json building;
+    building["id"] = b.getID();
+    building["name"] = string(b.getName());
+    building["address"] = string(b.getStreetAddress());
+    building["lat"] = location.first;
+    building["lon"] = location.second;
+    building["node_count"] = b.getNodeIDs().size();
+    return building;
+}
+
 // List all buildings
 json listBuildings() {
     json response;
     response["success"] = true;
     response["buildings"] = json::array();
 
-    vector<Building> mapBuildings = buildings.getMapBuildings();
-
-    for (const Building& b : mapBuildings) {
-        auto location = b.getLocation(nodes);
-
-        json building;
-        building["id"] = b.getID();
-        building["name"] = b.getName();
-        building["address"] = b.getStreetAddress();
-        building["lat"] = location.first;
-        building["lon"] = location.second;
-        building["node_count"] = b.getNodeIDs().size();
-
-        response["buildings"].push_back(building);
+    for (const Building& b : buildings.getMapBuildings()) {
+        response["buildings"].push_back(buildingToJson(b));
     }
 
     return response;
 }
 
+// True if text contains lowerQuery (already lower case), ignoring case
+static bool containsIgnoringCase(string_view text, const string& lowerQuery) {
+    auto it = search(text.begin(), text.end(), lowerQuery.begin(), lowerQuery.end(),
+        [](char c, char q) { return ::tolower((unsigned char) c) == q; });
+    return it != text.end() || lowerQuery.empty();
+}
+
 // Search buildings by name (partial match)
 json searchBuildings(const string& query) {
     json response;
     response["success"] = true;
     response["buildings"] = json::array();
 
-    vector<Building> mapBuildings = buildings.getMapBuildings();
     string lowerQuery = query;
     transform(lowerQuery.begin(), lowerQuery.end(), lowerQuery.begin(), ::tolower);
 
-    for (const Building& b : mapBuildings) {
-        string name = b.getName();
-        string lowerName = name;
-        transform(lowerName.begin(), lowerName.end(), lowerName.begin(), ::tolower);
-
-        // Check if name contains query
-        if (lowerName.find(lowerQuery) != string::npos) {
-            auto location = b.getLocation(nodes);
-
-            json building;
-            building["id"] = b.getID();
-            building["name"] = name;
-            building["address"] = b.getStreetAddress();
-            building["lat"] = location.first;
-            building["lon"] = location.second;
-            building["node_count"] = b.getNodeIDs().size();
-
-            response["buildings"].push_back(building);
+    for (const Building& b : buildings.getMapBuildings()) {
+        // Check if name contains query (the name is compared in place,
+        // so only matches are copied into the response)
+        if (containsIgnoringCase(b.getName(), lowerQuery)) {
+            response["buildings"].push_back(buildingToJson(b));
         }
     }
 
@@ -116,20 +153,32 @@ json searchBuildings(const string& query) {
 json getBuildingDetails(long long buildingId) {
     json response;
 
-    vector<Building> mapBuildings = buildings.getMapBuildings();
-
-    for (const Building& b : mapBuildings) {
+    for (const Building& b : buildings.getMapBuildings()) {
         if (b.getID() == buildingId) {
             auto location = b.getLocation(nodes);
 
             response["success"] = true;
             response["building"]["id"] = b.getID();
-            response["building"]["name"] = b.getName();
-            response["building"]["address"] = b.getStreetAddress();
+            response["building"]["name"] = string(b.getName());
+            response["building"]["address"] = string(b.getStreetAddress());
             response["building"]["lat"] = location.first;
             response["building"]["lon"] = location.second;
             response["building"]["node_count"] = b.getNodeIDs().size();
 
+            const BuildingGeometry& g = b.getGeometry();
+            response["building"]["bbox"]["min_lat"] = g.MinLat;
+            response["building"]["bbox"]["min_lon"] = g.MinLon;
+            response["building"]["bbox"]["max_lat"] = g.MaxLat;
+            response["building"]["bbox"]["max_lon"] = g.MaxLon;
+            response["building"]["area_m2"] = g.Area;
+            response["building"]["entrances"] = json::array();
+            for (const auto& entrance : b.getEntrances()) {
+                json e;
+                e["lat"] = entrance.getLat();
+                e["lon"] = entrance.getLon();
+                response["building"]["entrances"].push_back(e);
+            }
+
             return response;
         }
     }
@@ -139,6 +188,53 @@ json getBuildingDetails(long long buildingId) {
     return response;
 }
 
+// Find the buildings whose outline contains a location, smallest first
+json findBuildingsAt(double lat, double lon) {
+    json response;
+    response["success"] = true;
+    response["buildings"] = json::array();
+
+    for (const Building* b : buildings.findContaining(nodes, lat, lon)) {
+        response["buildings"].push_back(buildingToJson(*b));
+    }
+
+    return response;
+}
+
+// Find the buildings whose bounding box intersects a box, in map order
+json findBuildingsInBox(const BoundingBox& box) {
+    json response;
+
+    if (box.MinLat > box.MaxLat || box.MinLon > box.MaxLon) {
+        response["success"] = false;
+        response["error"] = "min_lat/min_lon must not be greater than max_lat/max_lon";
+        return response;
+    }
+
+    response["success"] = true;
+    response["buildings"] = json::array();
+
+    for (const Building* b : buildings.findInBox(box)) {
+        response["buildings"].push_back(buildingToJson(*b));
+    }
+
+    return response;
+}
+
+// One stop's fields, as the stop commands return them
+json stopToJson(const BusStop& stop, double distance) {
+    json result;
+    result["id"] = string(stop.getID());
+    result["route"] = string(stop.getRoute());
+    result["name"] = string(stop.getName());
+    result["direction"] = string(stop.getDirection());
+    result["location"] = string(stop.getLocation());
+    result["lat"] = stop.getLat();
+    result["lon"] = stop.getLon();
+    result["distance"] = distance;
+    return result;
+}
+
 // Find nearest bus stops to a location
 json findNearestStops(double lat, double lon) {
     json response;
@@ -153,34 +249,95 @@ json findNearestStops(double lat, double lon) {
     // Find closest stops (north and south)
     pair<BusStop, BusStop> closest = busStops->closestStops(lat, lon);
 
-    // Northbound stop
-    json northbound;
-    northbound["id"] = closest.first.getID();
-    northbound["route"] = "201"; // Default route
-    northbound["name"] = closest.first.getName();
-    northbound["direction"] = closest.first.getDirection();
-    northbound["location"] = closest.first.getLocation();
-    northbound["lat"] = closest.first.getLat();
-    northbound["lon"] = closest.first.getLon();
-    northbound["distance"] = closest.first.getDistance();
-
-    // Southbound stop
-    json southbound;
-    southbound["id"] = closest.second.getID();
-    southbound["route"] = "201"; // Default route
-    southbound["name"] = closest.second.getName();
-    southbound["direction"] = closest.second.getDirection();
-    southbound["location"] = closest.second.getLocation();
-    southbound["lat"] = closest.second.getLat();
-    southbound["lon"] = closest.second.getLon();
-    southbound["distance"] = closest.second.getDistance();
-
-    response["stops"]["northbound"] = northbound;
-    response["stops"]["southbound"] = southbound;
+    response["stops"]["northbound"] = stopToJson(closest.first, closest.first.getDistance());
+    response["stops"]["southbound"] = stopToJson(closest.second, closest.second.getDistance());
 
     return response;
 }
 
+// Find the k nearest bus stops to a location within a radius (miles),
+// on any of the given routes and going any of the given directions
+// (empty lists allow any), nearest first
+json findStopsNear(double lat, double lon, long long k, double radius, const StopFilter& filter) {
+    json response;
+
+    if (!busStops) {
+        response["success"] = false;
+        response["error"] = "Bus stops not loaded";
+        return response;
+    }
+    if (k < 1 || radius < 0) {
+        response["success"] = false;
+        response["error"] = "k must be at least 1 and radius at least 0";
+        return response;
+    }
+
+    response["success"] = true;
+    response["stops"] = json::array();
+
+    for (const NearbyStop& nearby : busStops->nearestStops(lat, lon, (size_t) k, radius, filter)) {
+        response["stops"].push_back(stopToJson(*nearby.Stop, nearby.Distance));
+    }
+
+    return response;
+}
+
+// Find the k nearest bus stops to each of many locations, as
+// findStopsNear does for one; results are in the order of the points
+json findStopsNearBatch(const vector<pair<double, double>>& points, long long k, double radius,
+                        const StopFilter& filter) {
+    json response;
+
+    if (!busStops) {
+        response["success"] = false;
+        response["error"] = "Bus stops not loaded";
+        return response;
+    }
+    if (k < 1 || radius < 0) {
+        response["success"] = false;
+        response["error"] = "k must be at least 1 and radius at least 0";
+        return response;
+    }
+
+    response["success"] = true;
+    response["results"] = json::array();
+
+    for (const vector<NearbyStop>& found : busStops->nearestStopsBatch(points, (size_t) k, radius, filter, loadThreads)) {
+        json stops = json::array();
+        for (const NearbyStop& nearby : found) {
+            stops.push_back(stopToJson(*nearby.Stop, nearby.Distance));
+        }
+        response["results"].push_back(stops);
+    }
+
+    return response;
+}
+
+// Read the optional k, radius, routes and directions of a stop query;
+// returns true if any was given
+static bool readStopQuery(const json& command, long long& k, double& radius, StopFilter& filter) {
+    bool given = false;
+
+    if (command.find("k") != command.end()) {
+        k = command.at("k");
+        given = true;
+    }
+    if (command.find("radius") != command.end()) {
+        radius = command.at("radius");
+        given = true;
+    }
+    if (command.find("routes") != command.end()) {
+        filter.Routes = command.at("routes").get<vector<string>>();
+        given = true;
+    }
+    if (command.find("directions") != command.end()) {
+        filter.Directions = command.at("directions").get<vector<string>>();
+        given = true;
+    }
+
+    return given;
+}
+
 // List all nodes (for map rendering)
 json listNodes() {
     json response;
@@ -194,64 +351,272 @@ json listNodes() {
     return response;
 }
 
-// Main function - read JSON from stdin, process, output to stdout
-int main() {
-    try {
-        // Load data on startup
-        if (!loadData()) {
-            json errorResponse;
-            errorResponse["success"] = false;
-            errorResponse["error"] = "Failed to load OSM data";
-            cout << errorResponse.dump() << endl;
-            return 1;
+// Node instrumentation counters (see nodestats.h): nodes added, and
+// lookups by ID and how many missed; and map sizes.
+// The counters are only kept in diagnostic builds (make build-api STATS=1);
+// "node_stats_enabled" says whether they were.
+json getStats() {
+    json response;
+    response["success"] = true;
+
+    response["node_stats_enabled"] = NodeStats::Enabled;
+
+    NodeCounts counts = Nodes::getCounts();
+    response["node_stats"]["added"] = counts.Added;
+    response["node_stats"]["lookups"] = counts.Lookups;
+    response["node_stats"]["misses"] = counts.Misses;
+
+    response["num_nodes"] = nodes.getNumMapNodes();
+    response["node_index"] = nodeIndexKindName(nodes.getIndexKind());
+    response["node_memory_bytes"] = nodes.getMemoryUsage();
+    response["distance_kernel"] = distanceKernelName(getDistanceKernel());
+    response["dangling_node_refs"] = loadReport.NumDanglingRefs;
+    response["num_buildings"] = buildings.getNumMapBuildings();
+
+    return response;
+}
+
+// Execute a single JSON command against the loaded data
+json handleCommand(const json& command) {
+    // Extract command type
+    string cmdType = command.at("command");
+
+    // Execute command
+    json response;
+
+    if (cmdType == "list_buildings") {
+        response = listBuildings();
+    }
+    else if (cmdType == "search_building") {
+        string query = command.at("query");
+        response = searchBuildings(query);
+    }
+    else if (cmdType == "get_building") {
+        long long buildingId = command.at("building_id");
+        response = getBuildingDetails(buildingId);
+    }
+    else if (cmdType == "building_at") {
+        double lat = command.at("lat");
+        double lon = command.at("lon");
+        response = findBuildingsAt(lat, lon);
+    }
+    else if (cmdType == "buildings_in_bbox") {
+        BoundingBox box;
+        box.MinLat = command.at("min_lat");
+        box.MinLon = command.at("min_lon");
+        box.MaxLat = command.at("max_lat");
+        box.MaxLon = command.at("max_lon");
+        response = findBuildingsInBox(box);
+    }
+    else if (cmdType == "nearest_stops") {
+        double lat = command.at("lat");
+        double lon = command.at("lon");
+
+        // with any of k, radius, routes or directions: a list of stops
+        long long k = 10;
+        double radius = numeric_limits<double>::max();
+        StopFilter filter;
+
+        if (readStopQuery(command, k, radius, filter)) {
+            response = findStopsNear(lat, lon, k, radius, filter);
+        }
+        else {
+            response = findNearestStops(lat, lon);
+        }
+    }
+    else if (cmdType == "nearest_stops_batch") {
+        // points: [{"lat": .., "lon": ..}, ...]
+        vector<pair<double, double>> points;
+        for (const json& point : command.at("points")) {
+            points.push_back(make_pair(point.at("lat").get<double>(), point.at("lon").get<double>()));
         }
 
-        // Read JSON from stdin
-        string input;
-        getline(cin, input);
+        long long k = 10;
+        double radius = numeric_limits<double>::max();
+        StopFilter filter;
+        readStopQuery(command, k, radius, filter);
+
+        response = findStopsNearBatch(points, k, radius, filter);
+    }
+    else if (cmdType == "list_nodes") {
+        response = listNodes();
+    }
+    else if (cmdType == "stats") {
+        response = getStats();
+    }
+    else {
+        response["success"] = false;
+        response["error"] = "Unknown command: " + cmdType;
+    }
+
+    return response;
+}
 
-        // Parse input JSON
-        json command = json::parse(input);
+// Server mode - answer newline-delimited JSON commands until stdin closes.
+// The map stays resident between commands, and each response echoes the
+// command's "id" (if any) so the caller can match replies to requests.
+int runServer() {
+    string input;
 
-        // Extract command type
-        string cmdType = command["command"];
+    while (getline(cin, input)) {
+        if (input.empty()) {
+            continue;
+        }
 
-        // Execute command
         json response;
+        json id;
+
+        try {
+            json command = json::parse(input);
+
+            if (command.find("id") != command.end()) {
+                id = command.at("id");
+            }
+            response = handleCommand(command);
+        } catch (const exception& e) {
+            response["success"] = false;
+            response["error"] = string("Exception: ") + e.what();
+        }
+
+        if (!id.is_null()) {
+            response["id"] = id;
+        }
+
+        // endl flushes, so the caller sees the reply right away
+        cout << response.dump() << endl;
+    }
 
-        if (cmdType == "list_buildings") {
-            response = listBuildings();
+    return 0;
+}
+
+// Main function - read JSON from stdin, process, output to stdout
+//
+// Usage:
+//   json_api                   answer one command read from stdin, then exit
+//   json_api --server          answer one command per line until stdin closes
+//   json_api --snapshot FILE   load the map from a snapshot instead of the OSM file
+//   json_api --build-snapshot FILE
+//                              parse the OSM file, write a snapshot and exit
+//   json_api --timing          report load phase times on stderr
+//   json_api --threads N       parse the OSM file on N threads (default: one per core)
+//   json_api --map FILE        load the map from FILE (.osm or .osm.pbf) instead of data/nu.osm
+//   json_api --node-index KIND search nodes with a "sorted" (default), "eytzinger" or "hash"
+//                              index; a hash index also skips sorting the nodes, and
+//                              "packed" compresses the node ids instead
+//
+int main(int argc, char* argv[]) {
+    bool serverMode = false;
+    string snapshotFile;
+    string buildSnapshotFile;
+    bool timing = false;
+    NodeIndexKind nodeIndex = NodeIndexKind::SORTED;
+    bool usageError = false;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--server") {
+            serverMode = true;
         }
-        else if (cmdType == "search_building") {
-            string query = command["query"];
-            response = searchBuildings(query);
+        else if (arg == "--snapshot" && i + 1 < argc) {
+            snapshotFile = argv[++i];
         }
-        else if (cmdType == "get_building") {
-            long long buildingId = command["building_id"];
-            response = getBuildingDetails(buildingId);
+        else if (arg == "--build-snapshot" && i + 1 < argc) {
+            buildSnapshotFile = argv[++i];
         }
-        else if (cmdType == "nearest_stops") {
-            double lat = command["lat"];
-            double lon = command["lon"];
-            response = findNearestStops(lat, lon);
+        else if (arg == "--timing") {
+            timing = true;
         }
-        else if (cmdType == "list_nodes") {
-            response = listNodes();
+        else if (arg == "--threads" && i + 1 < argc) {
+            loadThreads = max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--map" && i + 1 < argc) {
+            osmFile = argv[++i];
+        }
+        else if (arg == "--node-index" && i + 1 < argc) {
+            usageError = !parseNodeIndexKind(argv[++i], nodeIndex);
         }
         else {
-            response["success"] = false;
-            response["error"] = "Unknown command: " + cmdType;
+            usageError = true;
         }
 
-        // Output JSON response to stdout
-        cout << response.dump() << endl;
+        if (usageError) {
+            cerr << "Usage: " << argv[0]
+                 << " [--server] [--timing] [--threads N] [--map FILE]"
+                 << " [--node-index sorted|eytzinger|hash|packed]"
+                 << " [--snapshot FILE | --build-snapshot FILE]" << endl;
+            return 1;
+        }
+    }
+
+    if (!buildSnapshotFile.empty()) {
+        if (!loadData()) {
+            cerr << "Error: Could not build snapshot" << endl;
+            return 1;
+        }
+
+        loadReport.startPhase();
+        if (!Snapshot::write(buildSnapshotFile, nodes, buildings, *busStops)) {
+            cerr << "Error: Could not build snapshot" << endl;
+            return 1;
+        }
+        loadReport.endPhase("snapshot write");
+
+        if (timing) {
+            cerr << "Load times:" << endl;
+            loadReport.print(cerr);
+        }
+        cerr << "Wrote snapshot '" << buildSnapshotFile << "': "
+             << nodes.getNumMapNodes() << " nodes, "
+             << buildings.getNumMapBuildings() << " buildings, "
+             << busStops->getMapStops().size() << " bus stops" << endl;
+        delete busStops;
+        return 0;
+    }
+
+    try {
+        // Select the node search index, built as the map is loaded (a
+        // snapshot needs sorted nodes, so this comes after building one)
+        nodes.setIndexKind(nodeIndex);
+
+        // Load data on startup
+        bool loaded = snapshotFile.empty() ? loadData() : loadSnapshot(snapshotFile);
+
+        if (!loaded) {
+            json errorResponse;
+            errorResponse["success"] = false;
+            errorResponse["error"] = "Failed to load OSM data";
+            cout << errorResponse.dump() << endl;
+            return 1;
+        }
+
+        if (timing) {
+            cerr << "Load times:" << endl;
+            loadReport.print(cerr);
+        }
+
+        int rc = 0;
+
+        if (serverMode) {
+            rc = runServer();
+        }
+        else {
+            // Read JSON from stdin
+            string input;
+            getline(cin, input);
+
+            // Parse input JSON
+            json command = json::parse(input);
+
+            // Output JSON response to stdout
+            cout << handleCommand(command).dump() << endl;
+        }
 
         // Cleanup
         if (busStops) {
             delete busStops;
         }
 
-        return 0;
+        return rc;
 
     } catch (const exception& e) {
         json errorResponse;
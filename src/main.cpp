@@ -9,11 +9,14 @@
 #include <string>
 #include "nodes.h"
 #include "osm.h"
+#include "maploader.h"
+#include "parallel.h"
 #include "tinyxml2.h"
 #include "buildings.h"
 #include "busstops.h"
 #include "busstop.h"
 #include "curl_util.h"
+#include "snapshot.h"
 #include "json.hpp"
 using json = nlohmann::json;
 
@@ -30,13 +33,13 @@ int main()
   }
   string filename;
   string filenametxt;
-  XMLDocument document;
   Nodes nodes;
   int nodesCount;
   Buildings buildings;
+  BusStops busStops;
+  bool loaded = false;
   string answer;
   int i;
-  vector<Building> mapBuildings;
 
 
 
@@ -48,25 +51,40 @@ int main()
   getline(cin, filename);
   filenametxt = "data/bus-stops.txt";
   
+  //
+  // A snapshot file (see --build-snapshot in json_api) already holds
+  // the parsed nodes, buildings and bus stops:
+  //
+  if (Snapshot::isSnapshotFile(filename))
+  {
+    Snapshot snapshot;
+    if (snapshot.open(filename))
+    {
+      snapshot.load(nodes, buildings, busStops);
+      buildings.resolveNodes(nodes, defaultThreadCount());
+      loaded = true;
+    }
+  }
+  else if (osmReadMapFile(filename, nodes, buildings))
+  {
+    busStops = BusStops(filenametxt);
+    loaded = true;
+  }
+
     //
     // Output total nodes and buildings
     //
-  if (osmLoadMapFile(filename, document))
+  if (loaded)
   {
-    nodes.readMapNodes(document);
-    buildings.readMapBuildings(document);
-    BusStops busStops(filenametxt);
-
     nodesCount = nodes.getNumMapNodes();
     cout << "# of nodes: " << nodesCount << endl;
     cout << "# of buildings: " << buildings.getNumMapBuildings() << endl;  
-    cout << "# of bus stops: " << busStops.MapStops.size() << endl;
+    cout << "# of bus stops: " << busStops.getMapStops().size() << endl;
     //
     // Process user input query for building
     //
     cout << endl << "Enter building name (partial or complete), or * to list, or @ for bus stops, or $ to end>" << endl;
     getline(cin, answer);
-    mapBuildings = buildings.getMapBuildings();
     while (answer != "$") 
     {
       if (answer == "*") //Return a list of all buildings
@@ -86,9 +104,9 @@ int main()
     //
     // Final statistics and terminate
     //
-    // cout << "# of calls to getID(): " << Node::getCallsToGetID() << endl;
-    // cout << "# of Nodes created: " << Node::getCreated() << endl;
-    // cout << "# of Nodes copied: " << Node::getCopied() << endl;
+    // cout << "# of nodes added: " << Nodes::getCounts().Added << endl;
+    // cout << "# of node lookups: " << Nodes::getCounts().Lookups << endl;
+    // cout << "# of node lookups missed: " << Nodes::getCounts().Misses << endl;
     //
     // done:
     //
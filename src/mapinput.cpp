@@ -0,0 +1,372 @@
+/*mapinput.cpp*/
+
+//
+// Reads a map file that may be compressed.
+//
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <climits>
+#include <algorithm>
+
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "mapinput.h"
+
+using namespace std;
+
+
+//
+// read the compressed file this many bytes at a time:
+//
+static const size_t COMPRESSED_CHUNK_SIZE = 1 << 18;
+
+
+//
+// magicCompression
+//
+// The compression given by the first bytes of a file.
+//
+static MapInput::Compression magicCompression(const unsigned char* magic, size_t length)
+{
+  if (length >= 2 && magic[0] == 0x1F && magic[1] == 0x8B)
+  {
+    return MapInput::GZIP;
+  }
+
+  if (length >= 4 && magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD)
+  {
+    return MapInput::ZSTD;
+  }
+
+  return MapInput::NONE;
+}
+
+
+MapInput::MapInput()
+  : Format(NONE), CompressedBegin(0), CompressedEnd(0), FileEof(false),
+    StreamEnd(false), Stream(nullptr), Error(false)
+{
+}
+
+MapInput::~MapInput()
+{
+  if (this->Stream == nullptr)
+  {
+    return;
+  }
+
+  if (this->Format == GZIP)
+  {
+    z_stream* zs = (z_stream*) this->Stream;
+    inflateEnd(zs);
+    delete zs;
+  }
+#ifdef HAVE_ZSTD
+  else if (this->Format == ZSTD)
+  {
+    ZSTD_freeDStream((ZSTD_DStream*) this->Stream);
+  }
+#endif
+}
+
+//
+// open
+//
+// The first bytes are read to detect the compression and kept in the
+// compressed buffer, so they are not lost for the decompressor (or,
+// for a plain file, for the reader).
+//
+bool MapInput::open(string filename)
+{
+  this->Filename = filename;
+  this->File.open(filename, ios::binary);
+
+  if (!this->File.good())
+  {
+    return false;
+  }
+
+  this->Compressed.resize(COMPRESSED_CHUNK_SIZE);
+  this->File.read(this->Compressed.data(), 4);
+  this->CompressedBegin = 0;
+  this->CompressedEnd = (size_t) this->File.gcount();
+  this->FileEof = (this->CompressedEnd < 4);
+
+  this->Format = magicCompression((const unsigned char*) this->Compressed.data(), this->CompressedEnd);
+
+  if (this->Format == GZIP)
+  {
+    z_stream* zs = new z_stream();
+
+    //
+    // 15 + 32: maximum window, and detect the gzip (or zlib) header:
+    //
+    if (inflateInit2(zs, 15 + 32) != Z_OK)
+    {
+      delete zs;
+      this->fail("cannot initialize zlib");
+      return false;
+    }
+
+    this->Stream = zs;
+  }
+  else if (this->Format == ZSTD)
+  {
+#ifdef HAVE_ZSTD
+    ZSTD_DStream* ds = ZSTD_createDStream();
+
+    if (ds == nullptr || ZSTD_isError(ZSTD_initDStream(ds)))
+    {
+      ZSTD_freeDStream(ds);
+      this->fail("cannot initialize zstd");
+      return false;
+    }
+
+    this->Stream = ds;
+#else
+    this->fail("zstd support is not compiled in (build with ZSTD=1)");
+    return false;
+#endif
+  }
+
+  return true;
+}
+
+//
+// fail
+//
+// Reports a decompression error; reading stops from here on.
+//
+void MapInput::fail(string message)
+{
+  cerr << "**ERROR: unable to decompress '" << this->Filename << "': " << message << "." << endl;
+  this->Error = true;
+}
+
+//
+// fillCompressed
+//
+// Reads the next chunk of the (compressed) file once the previous
+// one has been consumed. Returns false at end of file.
+//
+bool MapInput::fillCompressed()
+{
+  if (this->FileEof)
+  {
+    return false;
+  }
+
+  this->File.read(this->Compressed.data(), this->Compressed.size());
+  this->CompressedBegin = 0;
+  this->CompressedEnd = (size_t) this->File.gcount();
+
+  if (this->CompressedEnd == 0)
+  {
+    this->FileEof = true;
+  }
+
+  return this->CompressedEnd > 0;
+}
+
+//
+// readGzip
+//
+// Inflates into the buffer until it is full or the file ends. A gzip
+// file may hold several members back to back (e.g. from pigz, or from
+// concatenating .gz files); each is inflated in turn.
+//
+size_t MapInput::readGzip(char* buffer, size_t size)
+{
+  z_stream* zs = (z_stream*) this->Stream;
+
+  zs->next_out = (Bytef*) buffer;
+  zs->avail_out = (uInt) min(size, (size_t) UINT_MAX);
+  size_t wanted = zs->avail_out;
+
+  while (zs->avail_out > 0)
+  {
+    if (this->CompressedBegin == this->CompressedEnd)
+    {
+      this->fillCompressed();
+    }
+
+    if (this->StreamEnd)
+    {
+      if (this->CompressedBegin == this->CompressedEnd)
+      {
+        break;  // end of file after a complete member
+      }
+
+      inflateReset(zs);
+      this->StreamEnd = false;
+    }
+
+    zs->next_in = (Bytef*) this->Compressed.data() + this->CompressedBegin;
+    zs->avail_in = (uInt) (this->CompressedEnd - this->CompressedBegin);
+    uInt before = zs->avail_out;
+
+    int rc = inflate(zs, Z_NO_FLUSH);
+    this->CompressedBegin = this->CompressedEnd - zs->avail_in;
+
+    if (rc == Z_STREAM_END)
+    {
+      this->StreamEnd = true;
+      continue;
+    }
+
+    if (rc != Z_OK && rc != Z_BUF_ERROR)
+    {
+      this->fail(zs->msg != nullptr ? zs->msg : "corrupt gzip data");
+      break;
+    }
+
+    if (this->FileEof && this->CompressedBegin == this->CompressedEnd && zs->avail_out == before)
+    {
+      this->fail("file is truncated");
+      break;
+    }
+  }
+
+  return wanted - zs->avail_out;
+}
+
+//
+// readZstd
+//
+// Same as readGzip, for zstd. The decompressor moves from one frame
+// to the next on its own.
+//
+size_t MapInput::readZstd([[maybe_unused]] char* buffer, [[maybe_unused]] size_t size)
+{
+#ifdef HAVE_ZSTD
+  ZSTD_DStream* ds = (ZSTD_DStream*) this->Stream;
+  ZSTD_outBuffer out = { buffer, size, 0 };
+
+  while (out.pos < out.size)
+  {
+    if (this->CompressedBegin == this->CompressedEnd)
+    {
+      this->fillCompressed();
+    }
+
+    ZSTD_inBuffer in = { this->Compressed.data() + this->CompressedBegin,
+                         this->CompressedEnd - this->CompressedBegin, 0 };
+    size_t before = out.pos;
+
+    size_t rc = ZSTD_decompressStream(ds, &out, &in);
+    this->CompressedBegin += in.pos;
+
+    if (ZSTD_isError(rc))
+    {
+      this->fail(ZSTD_getErrorName(rc));
+      break;
+    }
+
+    //
+    // 0 means a frame just ended; with no input and no output left, the
+    // decompressor returns a hint for the next frame's header instead,
+    // which says nothing about the frame before:
+    //
+    if (in.pos > 0 || out.pos > before)
+    {
+      this->StreamEnd = (rc == 0);
+    }
+
+    if (this->FileEof && this->CompressedBegin == this->CompressedEnd && out.pos == before)
+    {
+      if (!this->StreamEnd)
+      {
+        this->fail("file is truncated");
+      }
+      break;
+    }
+  }
+
+  return out.pos;
+#else
+  return 0;
+#endif
+}
+
+//
+// read
+//
+size_t MapInput::read(char* buffer, size_t size)
+{
+  if (this->Error || size == 0)
+  {
+    return 0;
+  }
+
+  if (this->Format == GZIP)
+  {
+    return this->readGzip(buffer, size);
+  }
+
+  if (this->Format == ZSTD)
+  {
+    return this->readZstd(buffer, size);
+  }
+
+  //
+  // plain file: the bytes read by open() first, then the file
+  //
+  size_t n = min(size, this->CompressedEnd - this->CompressedBegin);
+  copy(this->Compressed.data() + this->CompressedBegin,
+       this->Compressed.data() + this->CompressedBegin + n, buffer);
+  this->CompressedBegin += n;
+
+  if (n < size && !this->FileEof)
+  {
+    this->File.read(buffer + n, size - n);
+    n += (size_t) this->File.gcount();
+  }
+
+  return n;
+}
+
+bool MapInput::readFully(char* buffer, size_t size)
+{
+  size_t total = 0;
+
+  while (total < size)
+  {
+    size_t n = this->read(buffer + total, size - total);
+    if (n == 0)
+    {
+      return false;
+    }
+    total += n;
+  }
+
+  return true;
+}
+
+MapInput::Compression MapInput::getCompression() const
+{
+  return this->Format;
+}
+
+MapInput::Compression MapInput::detectCompression(string filename)
+{
+  ifstream infile(filename, ios::binary);
+  unsigned char magic[4];
+
+  infile.read((char*) magic, sizeof(magic));
+  return magicCompression(magic, (size_t) infile.gcount());
+}
+
+bool MapInput::isSupported(Compression compression)
+{
+#ifdef HAVE_ZSTD
+  return true;
+#else
+  return compression != ZSTD;
+#endif
+}
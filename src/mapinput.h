@@ -0,0 +1,112 @@
+/*mapinput.h*/
+
+//
+// Reads a map file that may be compressed.
+//
+// Map files are often kept gzip- or zstd-compressed. MapInput looks
+// at the first bytes of the file and, if they are a gzip or zstd
+// magic number, decompresses the file as it is read, a chunk at a
+// time: the readers see plain OSM XML (or PBF) and neither a
+// temporary file nor a copy of the whole expanded file is needed.
+// Uncompressed files are read through unchanged.
+//
+// gzip support uses zlib. zstd support needs libzstd and is only
+// compiled in when HAVE_ZSTD is defined (make build-api ZSTD=1);
+// otherwise zstd files are recognized and rejected with an error.
+//
+// References:
+//
+//   gzip: https://www.rfc-editor.org/rfc/rfc1952
+//   zstd: https://www.rfc-editor.org/rfc/rfc8878
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+using namespace std;
+
+
+//
+// MapInput
+//
+// A map file opened for reading, decompressed on the fly if needed.
+//
+class MapInput
+{
+public:
+  enum Compression { NONE, GZIP, ZSTD };
+
+private:
+  ifstream File;
+  string Filename;
+  Compression Format;
+  vector<char> Compressed;  // compressed bytes read but not yet consumed
+  size_t CompressedBegin;
+  size_t CompressedEnd;
+  bool FileEof;
+  bool StreamEnd;           // the current gzip member / zstd frame is done
+  void* Stream;             // z_stream or ZSTD_DStream
+
+  bool fillCompressed();
+  size_t readGzip(char* buffer, size_t size);
+  size_t readZstd(char* buffer, size_t size);
+  void fail(string message);
+
+  //
+  // not copyable, since we own the decompression stream:
+  //
+  MapInput(const MapInput&) = delete;
+  MapInput& operator=(const MapInput&) = delete;
+
+public:
+  bool Error;
+
+  MapInput();
+  ~MapInput();
+
+  //
+  // open
+  //
+  // Opens the given file and detects its compression. Returns false
+  // if the file cannot be opened, or is compressed in a format this
+  // build cannot read.
+  //
+  bool open(string filename);
+
+  //
+  // read
+  //
+  // Reads up to size bytes of decompressed data into buffer. Returns
+  // the number of bytes read, 0 at end of file or on error (in which
+  // case Error is set and a message has been printed).
+  //
+  size_t read(char* buffer, size_t size);
+
+  //
+  // readFully
+  //
+  // Reads exactly size bytes, unless the end of the file comes first.
+  // Returns true if all of them were read.
+  //
+  bool readFully(char* buffer, size_t size);
+
+  Compression getCompression() const;
+
+  //
+  // detectCompression
+  //
+  // The compression of the given file, from its magic number (NONE
+  // if it cannot be read).
+  //
+  static Compression detectCompression(string filename);
+
+  //
+  // isSupported
+  //
+  // True if this build can decompress the given format.
+  //
+  static bool isSupported(Compression compression);
+};
@@ -0,0 +1,579 @@
+/*maploader.cpp*/
+
+//
+// Builds the map model (nodes, buildings, entrances) from an Open
+// Street Map file in a single pass.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstring>
+#include <cassert>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "maploader.h"
+#include "mapinput.h"
+#include "numparse.h"
+#include "osmpbf.h"
+#include "parallel.h"
+
+using namespace std;
+using namespace tinyxml2;
+
+
+//
+// MapTags
+//
+// Everything the model needs from an element's tags, compiled once
+// and answered in one scan over them:
+//
+//   - entrance=yes|main|entrance marks a node as a building entrance
+//   - building=university marks a way as a campus building
+//   - name, addr:housenumber and addr:street describe the building
+//
+// As with osmGetKeyValue, the first tag with a given key wins.
+//
+struct MapTags
+{
+  TagMatcher Matcher;
+  int Entrance;
+  int Building;
+  int Name;
+  int HouseNumber;
+  int Street;
+
+  MapTags()
+  {
+    this->Entrance = this->Matcher.addKeyValues("entrance", { "yes", "main", "entrance" });
+    this->Building = this->Matcher.addKeyValue("building", "university");
+    this->Name = this->Matcher.addKey("name");
+    this->HouseNumber = this->Matcher.addKey("addr:housenumber");
+    this->Street = this->Matcher.addKey("addr:street");
+  }
+
+  //
+  // the address is built in the given string, so a reused one needs
+  // no allocation per building:
+  //
+  string_view getStreetAddress(const TagMatch& match, string& streetAddr) const
+  {
+    streetAddr.assign(match.value(this->HouseNumber));
+    streetAddr += " ";
+    streetAddr += match.value(this->Street);
+    return streetAddr;
+  }
+};
+
+static const MapTags& mapTags()
+{
+  static const MapTags tags;
+  return tags;
+}
+
+
+//
+// LoadReport
+//
+LoadReport::LoadReport()
+  : Start(chrono::steady_clock::now()), NumElements(0), NumNodes(0),
+    NumEntrances(0), NumWays(0), NumBuildings(0), NumDanglingRefs(0)
+{
+}
+
+void LoadReport::startPhase()
+{
+  this->Start = chrono::steady_clock::now();
+}
+
+void LoadReport::endPhase(string name)
+{
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - this->Start;
+
+  this->Phases.emplace_back(name, elapsed.count());
+  this->startPhase();
+}
+
+void LoadReport::addPhase(string name, double seconds)
+{
+  this->Phases.emplace_back(name, seconds);
+}
+
+void LoadReport::print(ostream& output) const
+{
+  double total = 0.0;
+
+  output << fixed << setprecision(2);
+  for (const auto& phase : this->Phases)
+  {
+    output << "  " << left << setw(16) << phase.first + ":" << right
+           << setw(10) << phase.second * 1000.0 << " ms" << endl;
+    total += phase.second;
+  }
+  output << "  " << left << setw(16) << "total:" << right
+         << setw(10) << total * 1000.0 << " ms" << endl;
+  output << defaultfloat << setprecision(6);
+
+  if (this->NumElements == 0)  // e.g. loaded from a snapshot
+  {
+    output << "  " << this->NumNodes << " nodes, " << this->NumBuildings << " buildings" << endl;
+  }
+  else
+  {
+    output << "  " << this->NumElements << " elements: "
+           << this->NumNodes << " nodes (" << this->NumEntrances << " entrances), "
+           << this->NumWays << " ways (" << this->NumBuildings << " buildings)" << endl;
+  }
+
+  if (this->Order.Sorted || this->Order.NumDuplicates > 0)
+  {
+    output << "  node order repaired: " << this->Order.NumOutOfOrder << " out of order, "
+           << this->Order.NumDuplicates << " duplicate ids removed" << endl;
+  }
+
+  if (this->NumDanglingRefs > 0)
+  {
+    output << "  " << this->NumDanglingRefs << " building node refs dangling (no such node)" << endl;
+  }
+}
+
+
+//
+// MapLoader
+//
+MapLoader::MapLoader(Nodes& nodes, Buildings& buildings, LoadReport& report)
+  : MapNodes(nodes), MapBuildings(buildings), Report(report),
+    Match(mapTags().Matcher.newMatch())
+{
+}
+
+//
+// loadFile
+//
+// Streams the given OSM XML file through node() and way().
+//
+bool MapLoader::loadFile(string filename)
+{
+  this->Report.startPhase();
+
+  bool success = osmStreamMapFile(filename, *this);
+
+  this->Report.endPhase("stream + ingest");
+
+  this->finishLoad(1);
+  return success;
+}
+
+//
+// finishLoad
+//
+// Nodes in a well-formed file are already in order, so ordering them
+// is usually a single scan. Resolving comes after, since ordering may
+// move the nodes.
+//
+void MapLoader::finishLoad(int numThreads)
+{
+  this->Report.Order = this->MapNodes.ensureOrder(numThreads);
+  this->Report.endPhase("order nodes");
+
+  const NodeOrder& order = this->Report.Order;
+
+  if (order.Sorted)
+  {
+    cerr << "**NOTE: " << order.NumOutOfOrder << " nodes were out of ID order; sorted them." << endl;
+  }
+  if (order.NumDuplicates > 0)
+  {
+    cerr << "**NOTE: removed " << order.NumDuplicates << " nodes with duplicate IDs (kept the last of each)." << endl;
+  }
+
+  this->Report.startPhase();
+  this->Report.NumDanglingRefs = this->MapBuildings.resolveNodes(this->MapNodes, numThreads);
+  this->Report.endPhase("resolve refs");
+}
+
+//
+// loadFileParallel
+//
+// Maps the file, splits it into ranges and streams each range on its
+// own thread through its own MapLoader.
+//
+bool MapLoader::loadFileParallel(string filename, int numThreads)
+{
+  //
+  // a compressed file cannot be split without decompressing it first:
+  //
+  if (MapInput::detectCompression(filename) != MapInput::NONE)
+  {
+    return this->loadFile(filename);
+  }
+
+  this->Report.startPhase();
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  struct stat info;
+
+  if (fd < 0 || fstat(fd, &info) != 0)
+  {
+    cerr << "**ERROR: unable to open XML file '" << filename << "'." << endl;
+    if (fd >= 0) close(fd);
+    return false;
+  }
+
+  size_t size = (size_t) info.st_size;
+  void* mapping = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  close(fd);
+
+  if (mapping == MAP_FAILED)
+  {
+    cerr << "**ERROR: unable to map XML file '" << filename << "'." << endl;
+    return false;
+  }
+
+  madvise(mapping, size, MADV_SEQUENTIAL);
+  const char* data = (const char*) mapping;
+
+  vector<size_t> starts = osmSplitMapBuffer(data, size, numThreads);
+  int numParts = (int) starts.size();
+  starts.push_back(size);
+
+  this->Report.endPhase("map + split");
+
+  //
+  // parse each range into its own collections:
+  //
+  vector<Nodes> partNodes(numParts);
+  vector<Buildings> partBuildings(numParts);
+  vector<LoadReport> partReports(numParts);
+  vector<char> partSuccess(numParts, 0);
+
+  parallelFor(numParts, [&](int p) {
+    MapLoader loader(partNodes[p], partBuildings[p], partReports[p]);
+    partSuccess[p] = osmStreamMapBuffer(data + starts[p], starts[p + 1] - starts[p], loader, p > 0);
+  });
+
+  munmap(mapping, size);
+  this->Report.endPhase("parallel parse");
+
+  bool success = true;
+  for (int p = 0; p < numParts; p++)
+  {
+    success = success && partSuccess[p];
+
+    this->Report.NumElements += partReports[p].NumElements;
+    this->Report.NumNodes += partReports[p].NumNodes;
+    this->Report.NumEntrances += partReports[p].NumEntrances;
+    this->Report.NumWays += partReports[p].NumWays;
+    this->Report.NumBuildings += partReports[p].NumBuildings;
+  }
+
+  //
+  // append the parts in file order:
+  //
+  for (int p = 0; p < numParts; p++)
+  {
+    this->MapNodes.append(partNodes[p]);
+
+    this->MapBuildings.append(partBuildings[p]);
+  }
+
+  this->Report.endPhase("merge");
+
+  this->finishLoad(numThreads);
+
+  return success;
+}
+
+//
+// loadPbfFile
+//
+// Reads a batch of blobs, decodes them concurrently through their own
+// MapLoaders, appends the results and moves on to the next batch.
+//
+bool MapLoader::loadPbfFile(string filename, int numThreads)
+{
+  this->Report.startPhase();
+
+  PbfReader reader;
+
+  if (!reader.open(filename))
+  {
+    cerr << "**ERROR: unable to open PBF file '" << filename << "'." << endl;
+    return false;
+  }
+
+  int batchSize = max(1, numThreads);
+  double readTime = 0.0, decodeTime = 0.0, mergeTime = 0.0;
+  bool success = true;
+
+  while (success)
+  {
+    auto start = chrono::steady_clock::now();
+
+    vector<PbfBlob> blobs;
+    PbfBlob blob;
+
+    while ((int) blobs.size() < batchSize && reader.nextBlob(blob))
+    {
+      blobs.push_back(std::move(blob));
+    }
+
+    if (blobs.empty())
+    {
+      break;
+    }
+
+    auto read = chrono::steady_clock::now();
+
+    int numBlobs = (int) blobs.size();
+    vector<Nodes> blobNodes(numBlobs);
+    vector<Buildings> blobBuildings(numBlobs);
+    vector<LoadReport> blobReports(numBlobs);
+    vector<string> blobErrors(numBlobs);
+
+    parallelFor(numBlobs, [&](int b) {
+      MapLoader loader(blobNodes[b], blobBuildings[b], blobReports[b]);
+      if (!pbfDecodeBlob(blobs[b], loader, blobErrors[b]) && blobErrors[b].empty())
+      {
+        blobErrors[b] = "decode failed";
+      }
+    });
+
+    auto decoded = chrono::steady_clock::now();
+
+    for (int b = 0; b < numBlobs; b++)
+    {
+      if (!blobErrors[b].empty())
+      {
+        cerr << "**ERROR: PBF file '" << filename << "': " << blobErrors[b] << "." << endl;
+        success = false;
+        break;
+      }
+
+      this->Report.NumElements += blobReports[b].NumElements;
+      this->Report.NumNodes += blobReports[b].NumNodes;
+      this->Report.NumEntrances += blobReports[b].NumEntrances;
+      this->Report.NumWays += blobReports[b].NumWays;
+      this->Report.NumBuildings += blobReports[b].NumBuildings;
+
+      this->MapNodes.append(blobNodes[b]);
+
+      this->MapBuildings.append(blobBuildings[b]);
+    }
+
+    auto merged = chrono::steady_clock::now();
+
+    readTime += chrono::duration<double>(read - start).count();
+    decodeTime += chrono::duration<double>(decoded - read).count();
+    mergeTime += chrono::duration<double>(merged - decoded).count();
+  }
+
+  if (reader.Error)
+  {
+    cerr << "**ERROR: PBF file '" << filename << "' is truncated or malformed." << endl;
+    success = false;
+  }
+
+  //
+  // the batches interleave, so report the total of each step:
+  //
+  this->Report.addPhase("read blobs", readTime);
+  this->Report.addPhase("parallel decode", decodeTime);
+  this->Report.addPhase("merge", mergeTime);
+
+  this->Report.startPhase();
+  this->finishLoad(numThreads);
+
+  return success;
+}
+
+//
+// load
+//
+// Picks the reader by looking at the start of the file.
+//
+bool MapLoader::load(string filename, int numThreads)
+{
+  if (isPbfFile(filename))
+  {
+    return this->loadPbfFile(filename, numThreads);
+  }
+
+  if (numThreads > 1)
+  {
+    return this->loadFileParallel(filename, numThreads);
+  }
+
+  return this->loadFile(filename);
+}
+
+//
+// node
+//
+// One streamed node: stored, and flagged if it is an entrance.
+//
+void MapLoader::node(const OsmElement& node)
+{
+  const MapTags& tags = mapTags();
+
+  this->Match.reset();
+  for (const auto& tag : node.Tags)
+  {
+    tags.Matcher.match(tag.first, tag.second, this->Match);
+  }
+
+  bool isEntrance = this->Match.has(tags.Entrance);
+
+  this->MapNodes.add(node.ID, node.Lat, node.Lon, isEntrance);
+
+  this->Report.NumElements++;
+  this->Report.NumNodes++;
+  this->Report.NumEntrances += isEntrance ? 1 : 0;
+}
+
+//
+// way
+//
+// One streamed way: stored as a building if it is a university
+// building, otherwise ignored.
+//
+void MapLoader::way(const OsmElement& way)
+{
+  this->Report.NumElements++;
+  this->Report.NumWays++;
+
+  const MapTags& tags = mapTags();
+
+  this->Match.reset();
+  for (const auto& tag : way.Tags)
+  {
+    tags.Matcher.match(tag.first, tag.second, this->Match);
+  }
+
+  if (!this->Match.has(tags.Building))
+  {
+    return;
+  }
+
+  this->MapBuildings.add(way.ID, this->Match.value(tags.Name), tags.getStreetAddress(this->Match, this->StreetAddr));
+
+  for (long long id : way.NodeRefs)
+  {
+    this->MapBuildings.addNodeID(id);
+  }
+
+  this->Report.NumBuildings++;
+}
+
+//
+// loadDocument
+//
+// A single walk over the <osm> element's children. Each <node> or
+// <way> has its tags scanned once, and only building ways have their
+// node refs read.
+//
+void MapLoader::loadDocument(XMLDocument& xmldoc)
+{
+  this->Report.startPhase();
+
+  XMLElement* osm = xmldoc.FirstChildElement("osm");
+  assert(osm != nullptr);
+
+  for (XMLElement* e = osm->FirstChildElement(); e != nullptr; e = e->NextSiblingElement())
+  {
+    bool isNode = (strcmp(e->Name(), "node") == 0);
+    bool isWay = (strcmp(e->Name(), "way") == 0);
+
+    if (!isNode && !isWay)
+    {
+      continue;
+    }
+
+    const XMLAttribute* attrId = e->FindAttribute("id");
+    assert(attrId != nullptr);
+
+    long long id;
+    parseInt64(attrId->Value(), id);
+
+    const MapTags& tags = mapTags();
+
+    this->Match.reset();
+    for (XMLElement* tag = e->FirstChildElement("tag"); tag != nullptr; tag = tag->NextSiblingElement("tag"))
+    {
+      const char* key = tag->Attribute("k");
+      const char* value = tag->Attribute("v");
+
+      if (key != nullptr && value != nullptr)
+      {
+        tags.Matcher.match(key, value, this->Match);
+      }
+    }
+
+    bool isEntrance = this->Match.has(tags.Entrance);
+
+    this->Report.NumElements++;
+
+    if (isNode)
+    {
+      const XMLAttribute* attrLat = e->FindAttribute("lat");
+      const XMLAttribute* attrLon = e->FindAttribute("lon");
+
+      assert(attrLat != nullptr);
+      assert(attrLon != nullptr);
+
+      double lat, lon;
+      parseCoordinate(attrLat->Value(), lat);
+      parseCoordinate(attrLon->Value(), lon);
+
+      this->MapNodes.add(id, lat, lon, isEntrance);
+
+      this->Report.NumNodes++;
+      this->Report.NumEntrances += isEntrance ? 1 : 0;
+    }
+    else
+    {
+      this->Report.NumWays++;
+
+      if (!this->Match.has(tags.Building))
+      {
+        continue;
+      }
+
+      this->MapBuildings.add(id, this->Match.value(tags.Name), tags.getStreetAddress(this->Match, this->StreetAddr));
+
+      for (XMLElement* nd = e->FirstChildElement("nd"); nd != nullptr; nd = nd->NextSiblingElement("nd"))
+      {
+        const XMLAttribute* ndref = nd->FindAttribute("ref");
+        assert(ndref != nullptr);
+        long long ref;
+        parseInt64(ndref->Value(), ref);
+        this->MapBuildings.addNodeID(ref);
+      }
+
+      this->Report.NumBuildings++;
+    }
+  }
+
+  this->Report.endPhase("ingest");
+
+  this->finishLoad(1);
+}
+
+
+//
+// osmReadMapFile
+//
+// Reads the given OSM XML or PBF file straight into the nodes and
+// buildings, in parallel if there is more than one core.
+//
+bool osmReadMapFile(string filename, Nodes& nodes, Buildings& buildings)
+{
+  LoadReport report;
+  MapLoader loader(nodes, buildings, report);
+
+  return loader.load(filename, defaultThreadCount());
+}
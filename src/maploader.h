@@ -0,0 +1,175 @@
+/*maploader.h*/
+
+//
+// Builds the map model (nodes, buildings, entrances) from an Open
+// Street Map file in a single pass.
+//
+// readMapNodes and readMapBuildings each walk the whole document, and
+// every osmContainsKeyValue / osmGetKeyValue call rescans an element's
+// tags. The loader instead looks at each element once, scans its tags
+// once (with a precompiled TagMatcher) to classify it, and fills Nodes
+// and Buildings together. It also
+// times each load phase so the cost of loading large extracts can be
+// reported.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <iostream>
+#include <chrono>
+
+#include "nodes.h"
+#include "buildings.h"
+#include "osmstream.h"
+#include "tagmatch.h"
+#include "tinyxml2.h"
+
+using namespace std;
+using namespace tinyxml2;
+
+
+//
+// LoadReport
+//
+// Wall-clock time of each load phase, in the order the phases ran,
+// plus what was found.
+//
+class LoadReport
+{
+private:
+  vector<pair<string, double>> Phases;  // (name, seconds)
+  chrono::steady_clock::time_point Start;
+
+public:
+  long long NumElements;   // <node> and <way> elements seen
+  long long NumNodes;
+  long long NumEntrances;
+  long long NumWays;
+  long long NumBuildings;
+  NodeOrder Order;         // what ensureOrder repaired
+  long long NumDanglingRefs;  // building node IDs with no such node
+
+  LoadReport();
+
+  //
+  // startPhase / endPhase
+  //
+  // Times the code in between as the named phase.
+  //
+  void startPhase();
+  void endPhase(string name);
+
+  //
+  // addPhase
+  //
+  // Records a phase timed elsewhere, e.g. the sum of many short steps.
+  //
+  void addPhase(string name, double seconds);
+
+  //
+  // print
+  //
+  // Prints one line per phase, the total and the element counts.
+  //
+  void print(ostream& output) const;
+};
+
+
+//
+// MapLoader
+//
+// Fills the given Nodes and Buildings from an OSM file or document,
+// recording phase times and counts in the given report.
+//
+class MapLoader : public OsmHandler
+{
+private:
+  Nodes& MapNodes;
+  Buildings& MapBuildings;
+  LoadReport& Report;
+  TagMatch Match;  // reused for every element
+  string StreetAddr;  // reused for every building
+
+  //
+  // finishLoad
+  //
+  // The last load phases: sorts and dedupes the nodes if need be (see
+  // Nodes::ensureOrder), reporting any repair on cerr, then resolves
+  // the buildings' node IDs to node indices and computes their
+  // geometry (see Buildings::resolveNodes), counting dangling IDs in
+  // the report.
+  //
+  void finishLoad(int numThreads);
+
+public:
+  MapLoader(Nodes& nodes, Buildings& buildings, LoadReport& report);
+
+  //
+  // loadFile
+  //
+  // Streams the given OSM XML file (see osmstream.h), classifying
+  // and storing each element as it is read. Returns false if the
+  // file could not be read.
+  //
+  bool loadFile(string filename);
+
+  //
+  // loadFileParallel
+  //
+  // Same as loadFile, but the file is split into numThreads ranges
+  // on element boundaries (see osmSplitMapBuffer) that are parsed
+  // concurrently, each into its own nodes and buildings. The parts
+  // are then appended in file order and the nodes sorted by ID.
+  // Compressed files cannot be split, so they are streamed with
+  // loadFile instead.
+  //
+  bool loadFileParallel(string filename, int numThreads);
+
+  //
+  // loadPbfFile
+  //
+  // Reads the given OSM PBF file (see osmpbf.h). Blobs are read in
+  // batches of numThreads and each blob of a batch is decompressed and
+  // decoded on its own thread, into its own nodes and buildings, which
+  // are then appended in file order. The nodes are sorted by ID at the
+  // end. Returns false if the file could not be read or decoded.
+  //
+  bool loadPbfFile(string filename, int numThreads);
+
+  //
+  // load
+  //
+  // Loads the given map file in whichever format it is in: PBF if it
+  // starts like one, otherwise XML (in parallel if numThreads > 1),
+  // either of them possibly gzip- or zstd-compressed.
+  //
+  bool load(string filename, int numThreads);
+
+  //
+  // loadDocument
+  //
+  // Same as loadFile, for an already loaded XML document: a single
+  // walk over the <osm> element's children.
+  //
+  void loadDocument(XMLDocument& xmldoc);
+
+  //
+  // OsmHandler callbacks, one per streamed element:
+  //
+  void node(const OsmElement& node) override;
+  void way(const OsmElement& way) override;
+};
+
+
+//
+// osmReadMapFile
+//
+// Reads the given OSM XML or PBF file straight into the nodes and
+// buildings, the same as osmLoadMapFile followed by readMapNodes and
+// readMapBuildings but without building the XML document. Uses one
+// thread per core.
+//
+bool osmReadMapFile(string filename, Nodes& nodes, Buildings& buildings);
@@ -0,0 +1,389 @@
+/*nodeindex.cpp*/
+
+//
+// Search indexes over the node id column.
+//
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <functional>
+#include <algorithm>
+
+#include "nodeindex.h"
+
+using namespace std;
+
+
+//
+// parseNodeIndexKind / nodeIndexKindName
+//
+bool parseNodeIndexKind(string name, NodeIndexKind& kind)
+{
+  if (name == "sorted")
+    kind = NodeIndexKind::SORTED;
+  else if (name == "eytzinger")
+    kind = NodeIndexKind::EYTZINGER;
+  else if (name == "hash")
+    kind = NodeIndexKind::HASH;
+  else if (name == "packed")
+    kind = NodeIndexKind::PACKED;
+  else
+    return false;
+
+  return true;
+}
+
+string nodeIndexKindName(NodeIndexKind kind)
+{
+  switch (kind)
+  {
+    case NodeIndexKind::EYTZINGER: return "eytzinger";
+    case NodeIndexKind::HASH: return "hash";
+    case NodeIndexKind::PACKED: return "packed";
+    default: return "sorted";
+  }
+}
+
+
+//
+// EytzingerIndex
+//
+EytzingerIndex::EytzingerIndex()
+  : Offset(0), N(0)
+{
+}
+
+//
+// build
+//
+// An in-order walk of the implicit tree visits positions in key
+// order, so handing out the sorted ids in that walk fills the tree.
+//
+void EytzingerIndex::build(ArrayView<long long> sortedIDs)
+{
+  this->N = sortedIDs.size();
+
+  //
+  // room for positions 0 .. N, plus up to 7 to align position 0 (a
+  // copied index keeps Offset, so it stays correct if not aligned):
+  //
+  this->Keys.assign(this->N + 1 + 7, 0);
+  uintptr_t address = (uintptr_t) this->Keys.data();
+  this->Offset = ((64 - address % 64) % 64) / sizeof(long long);
+
+  this->Ranks.assign(this->N + 1, 0);
+
+  long long* keys = this->Keys.data() + this->Offset;
+  size_t next = 0;
+
+  function<void(size_t)> fill = [&](size_t k) {
+    if (k > this->N)
+    {
+      return;
+    }
+
+    fill(2 * k);
+    keys[k] = sortedIDs[next];
+    this->Ranks[k] = (uint32_t) next;
+    next++;
+    fill(2 * k + 1);
+  };
+
+  fill(1);
+}
+
+void EytzingerIndex::clear()
+{
+  this->Keys = vector<long long>();
+  this->Ranks = vector<uint32_t>();
+  this->Offset = 0;
+  this->N = 0;
+}
+
+//
+// find
+//
+// Walks down the tree, going right whenever the key is smaller than
+// the id, while prefetching the two lines holding the descendants
+// four levels down. The walk ends below a leaf; k then records the path
+// taken, and shifting out the trailing right turns (and the left turn
+// before them) leaves the last position where the walk went left: the
+// smallest key >= id.
+//
+bool EytzingerIndex::find(long long id, size_t& rank) const
+{
+  const long long* keys = this->Keys.data() + this->Offset;
+  size_t k = 1;
+
+  while (k <= this->N)
+  {
+    //
+    // the address is computed as an integer since it may be past the
+    // end of the array; prefetching it is harmless:
+    //
+    uintptr_t descendants = (uintptr_t) keys + 16 * k * sizeof(long long);
+    __builtin_prefetch((const void*) descendants);
+    __builtin_prefetch((const void*) (descendants + 64));
+    k = 2 * k + (keys[k] < id ? 1 : 0);
+  }
+
+  k >>= __builtin_ffsll((long long) ~k);
+
+  if (k == 0 || keys[k] != id)
+  {
+    return false;
+  }
+
+  rank = this->Ranks[k];
+  return true;
+}
+
+size_t EytzingerIndex::getMemoryUsage() const
+{
+  return this->Keys.capacity() * sizeof(long long) + this->Ranks.capacity() * sizeof(uint32_t);
+}
+
+
+//
+// HashIndex
+//
+HashIndex::HashIndex()
+  : Mask(0), Shift(64)
+{
+}
+
+//
+// home
+//
+// The entry where the search for id starts: the top bits of id times
+// 2^64 / golden ratio (Fibonacci hashing), which spreads the runs of
+// consecutive ids OSM files are full of evenly over the table.
+//
+size_t HashIndex::home(long long id) const
+{
+  return (size_t) (((uint64_t) id * 0x9E3779B97F4A7C15ULL) >> this->Shift);
+}
+
+//
+// build
+//
+// Sizes the table once up front, so it never has to grow.
+//
+void HashIndex::build(ArrayView<long long> ids, vector<size_t>& repeated)
+{
+  size_t capacity = 16;
+  while (capacity < 2 * ids.size())
+  {
+    capacity *= 2;
+  }
+
+  this->Keys.assign(capacity, EmptyKey);
+  this->Positions.assign(capacity, 0);
+  this->Mask = capacity - 1;
+  this->Shift = 64 - __builtin_ctzll(capacity);
+
+  repeated.clear();
+
+  for (size_t i = 0; i < ids.size(); i++)
+  {
+    size_t e = this->home(ids[i]);
+
+    while (this->Keys[e] != EmptyKey && this->Keys[e] != ids[i])
+    {
+      e = (e + 1) & this->Mask;
+    }
+
+    if (this->Keys[e] == ids[i])
+    {
+      repeated.push_back(this->Positions[e]);
+    }
+
+    this->Keys[e] = ids[i];
+    this->Positions[e] = (uint32_t) i;
+  }
+
+  sort(repeated.begin(), repeated.end());
+}
+
+void HashIndex::clear()
+{
+  this->Keys = vector<long long>();
+  this->Positions = vector<uint32_t>();
+  this->Mask = 0;
+  this->Shift = 64;
+}
+
+//
+// find
+//
+// Probes from the id's home entry until it finds the id or a free
+// entry. The table is at most half full, so a search for a missing id
+// also ends after a couple of entries on average.
+//
+bool HashIndex::find(long long id, size_t& position) const
+{
+  if (this->Keys.empty() || id == EmptyKey)
+  {
+    return false;
+  }
+
+  const long long* keys = this->Keys.data();
+  size_t e = this->home(id);
+
+  while (keys[e] != id)
+  {
+    if (keys[e] == EmptyKey)
+    {
+      return false;
+    }
+
+    e = (e + 1) & this->Mask;
+  }
+
+  position = this->Positions[e];
+  return true;
+}
+
+size_t HashIndex::getMemoryUsage() const
+{
+  return this->Keys.capacity() * sizeof(long long) + this->Positions.capacity() * sizeof(uint32_t);
+}
+
+
+//
+// PackedIDs
+//
+PackedIDs::PackedIDs()
+  : N(0)
+{
+}
+
+//
+// build
+//
+// Gaps are written 7 bits to a byte, low bits first, with the top bit
+// set on every byte but the last (LEB128).
+//
+void PackedIDs::build(ArrayView<long long> sortedIDs)
+{
+  this->clear();
+  this->N = sortedIDs.size();
+
+  size_t numBlocks = (this->N + BlockSize - 1) / BlockSize;
+  this->Heads.reserve(numBlocks);
+  this->Offsets.reserve(numBlocks);
+  this->Bytes.reserve(this->N + this->N / 4);
+
+  for (size_t i = 0; i < this->N; i++)
+  {
+    if (i % BlockSize == 0)
+    {
+      this->Heads.push_back(sortedIDs[i]);
+      this->Offsets.push_back((uint32_t) this->Bytes.size());
+      continue;
+    }
+
+    uint64_t gap = (uint64_t) (sortedIDs[i] - sortedIDs[i - 1] - 1);
+
+    while (gap >= 0x80)
+    {
+      this->Bytes.push_back((uint8_t) (gap | 0x80));
+      gap >>= 7;
+    }
+    this->Bytes.push_back((uint8_t) gap);
+  }
+
+  this->Bytes.shrink_to_fit();
+}
+
+//
+// decodeGap
+//
+// Reads one varint at p, advancing p past it.
+//
+static inline uint64_t decodeGap(const uint8_t*& p)
+{
+  uint64_t gap = *p & 0x7F;
+  int shift = 7;
+
+  while (*p++ & 0x80)
+  {
+    gap |= (uint64_t) (*p & 0x7F) << shift;
+    shift += 7;
+  }
+
+  return gap;
+}
+
+void PackedIDs::unpack(vector<long long>& sortedIDs) const
+{
+  sortedIDs.resize(this->N);
+
+  const uint8_t* p = this->Bytes.data();
+  long long id = 0;
+
+  for (size_t i = 0; i < this->N; i++)
+  {
+    if (i % BlockSize == 0)
+      id = this->Heads[i / BlockSize];
+    else
+      id += (long long) decodeGap(p) + 1;
+
+    sortedIDs[i] = id;
+  }
+}
+
+void PackedIDs::clear()
+{
+  this->Heads = vector<long long>();
+  this->Offsets = vector<uint32_t>();
+  this->Bytes = vector<uint8_t>();
+  this->N = 0;
+}
+
+//
+// find
+//
+// The last head <= id picks the block; decoding it stops at the first
+// id >= the one searched for.
+//
+bool PackedIDs::find(long long id, size_t& rank) const
+{
+  auto it = upper_bound(this->Heads.begin(), this->Heads.end(), id);
+
+  if (it == this->Heads.begin())
+  {
+    return false;
+  }
+
+  size_t block = (size_t) (it - this->Heads.begin()) - 1;
+  size_t i = block * BlockSize;
+  size_t end = min(this->N, i + BlockSize);
+  long long current = this->Heads[block];
+  const uint8_t* p = this->Bytes.data() + this->Offsets[block];
+
+  while (current < id && ++i < end)
+  {
+    current += (long long) decodeGap(p) + 1;
+  }
+
+  if (current != id)
+  {
+    return false;
+  }
+
+  rank = i;
+  return true;
+}
+
+size_t PackedIDs::size() const
+{
+  return this->N;
+}
+
+size_t PackedIDs::getMemoryUsage() const
+{
+  return this->Heads.capacity() * sizeof(long long) + this->Offsets.capacity() * sizeof(uint32_t)
+    + this->Bytes.capacity();
+}
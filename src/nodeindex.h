@@ -0,0 +1,240 @@
+/*nodeindex.h*/
+
+//
+// Search indexes over the node id column (see nodes.h).
+//
+// Nodes::find binary-searches the sorted id array. On a large map the
+// first dozen or so probes of every search land on different cache
+// lines far apart, and each one must wait for memory before the next
+// can even be computed.
+//
+// EytzingerIndex stores a copy of the sorted ids in Eytzinger (BFS)
+// order instead: the root at position 1, the children of position k
+// at 2k and 2k+1. The top levels of the tree, which every search
+// visits, are packed together at the front of the array and stay in
+// cache, and the 16 descendants four levels below position k sit
+// together at 16k .. 16k+15, so they can be prefetched while the
+// search walks down to them. The search loop has no unpredictable
+// branch.
+//
+// HashIndex maps ids to positions in the id column with an open
+// addressing hash table: two flat arrays (keys and positions), a
+// power-of-two capacity kept at least twice the number of ids, and
+// linear probing, so a lookup costs a multiply, a shift and usually a
+// single cache line. Unlike the other two it needs no sorted ids,
+// which lets a map be loaded without sorting its nodes.
+//
+// PackedIDs replaces the id column itself with a compressed copy, for
+// maps too large to keep 8 bytes per id resident. The sorted ids are
+// cut into blocks of 64; each block keeps its first id (the head) as
+// is, and the rest as varint-encoded gaps to the id before, which in
+// OSM extracts are mostly under 128 and so take a byte each. A search
+// binary-searches the heads, then decodes the one block that can hold
+// the id, about 1.3 bytes per id in all instead of 8.
+//
+// Reference:
+//
+//   P. Khuong and P. Morin, "Array Layouts for Comparison-Based
+//   Searching", ACM JEA 22, 2017 (https://arxiv.org/abs/1509.05053)
+//
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+#include "arrayview.h"
+
+using namespace std;
+
+
+//
+// NodeIndexKind
+//
+// The search structure Nodes::find uses.
+//
+enum class NodeIndexKind
+{
+  SORTED,     // binary search of the id column (no extra memory)
+  EYTZINGER,  // EytzingerIndex
+  HASH,       // HashIndex
+  PACKED      // PackedIDs, in place of the id column
+};
+
+//
+// parseNodeIndexKind / nodeIndexKindName
+//
+// Converts between a kind and its name ("sorted", "eytzinger", "hash",
+// "packed").
+// parseNodeIndexKind returns false for an unknown name.
+//
+bool parseNodeIndexKind(string name, NodeIndexKind& kind);
+string nodeIndexKindName(NodeIndexKind kind);
+
+
+//
+// EytzingerIndex
+//
+class EytzingerIndex
+{
+private:
+  //
+  // Keys[Offset + k] is the id at tree position k (1 .. N), with
+  // Offset chosen so that position 0 starts a cache line; Ranks[k]
+  // is that id's position in the sorted id column.
+  //
+  vector<long long> Keys;
+  size_t Offset;
+  vector<uint32_t> Ranks;
+  size_t N;
+
+public:
+  EytzingerIndex();
+
+  //
+  // build
+  //
+  // Builds the index over the given sorted, unique ids.
+  //
+  void build(ArrayView<long long> sortedIDs);
+
+  //
+  // clear
+  //
+  // Frees the index.
+  //
+  void clear();
+
+  //
+  // find
+  //
+  // Searches for the given id. Returns true if found, with its
+  // position in the sorted id column in rank.
+  //
+  bool find(long long id, size_t& rank) const;
+
+  //
+  // getMemoryUsage
+  //
+  // Bytes used by the index.
+  //
+  size_t getMemoryUsage() const;
+};
+
+
+//
+// HashIndex
+//
+class HashIndex
+{
+private:
+  //
+  // Keys[i] is EmptyKey for a free entry, otherwise an id whose
+  // position in the id column is Positions[i]. Probing walks the
+  // keys array alone, 8 to a cache line:
+  //
+  static constexpr long long EmptyKey = (-9223372036854775807LL - 1);
+
+  vector<long long> Keys;
+  vector<uint32_t> Positions;
+  size_t Mask;    // capacity - 1
+  int Shift;      // 64 - log2(capacity)
+
+  size_t home(long long id) const;
+
+public:
+  HashIndex();
+
+  //
+  // build
+  //
+  // Builds the index over the given ids, in any order. If an id
+  // repeats, the index keeps its last position; the earlier ones are
+  // returned in repeated (in ascending order).
+  //
+  void build(ArrayView<long long> ids, vector<size_t>& repeated);
+
+  //
+  // clear
+  //
+  // Frees the index.
+  //
+  void clear();
+
+  //
+  // find
+  //
+  // Searches for the given id. Returns true if found, with its
+  // position in the id column in position.
+  //
+  bool find(long long id, size_t& position) const;
+
+  //
+  // getMemoryUsage
+  //
+  // Bytes used by the index.
+  //
+  size_t getMemoryUsage() const;
+};
+
+
+//
+// PackedIDs
+//
+class PackedIDs
+{
+private:
+  static constexpr size_t BlockSize = 64;
+
+  //
+  // block b holds ids b*BlockSize ..; Heads[b] is its first id, and
+  // the gaps (minus 1, as ids are unique) to each of the others are
+  // varints in Bytes starting at Offsets[b]:
+  //
+  vector<long long> Heads;
+  vector<uint32_t> Offsets;
+  vector<uint8_t> Bytes;
+  size_t N;
+
+public:
+  PackedIDs();
+
+  //
+  // build
+  //
+  // Packs the given sorted, unique ids.
+  //
+  void build(ArrayView<long long> sortedIDs);
+
+  //
+  // unpack
+  //
+  // Decodes all the ids back into sortedIDs.
+  //
+  void unpack(vector<long long>& sortedIDs) const;
+
+  //
+  // clear
+  //
+  // Frees the packed ids.
+  //
+  void clear();
+
+  //
+  // find
+  //
+  // Searches for the given id. Returns true if found, with its
+  // position in the sorted ids in rank.
+  //
+  bool find(long long id, size_t& rank) const;
+
+  //
+  // size / getMemoryUsage
+  //
+  // The number of ids, and the bytes used to store them.
+  //
+  size_t size() const;
+  size_t getMemoryUsage() const;
+};
@@ -1,155 +1,477 @@
-/*nodes.cpp*/
-
-//
-// A collection of nodes in the Open Street Map.
-// References:
-// 
-// TinyXML: 
-//   files: https://github.com/leethomason/tinyxml2
-//   docs:  http://leethomason.github.io/tinyxml2/
-// 
-// OpenStreetMap: https://www.openstreetmap.org
-// OpenStreetMap docs:  
-//   https://wiki.openstreetmap.org/wiki/Main_Page
-//   https://wiki.openstreetmap.org/wiki/Map_Features
-//   https://wiki.openstreetmap.org/wiki/Node
-//   https://wiki.openstreetmap.org/wiki/Way
-//   https://wiki.openstreetmap.org/wiki/Relation
-//
-
-#include <iostream>
-#include <string>
-#include <vector>
-#include <algorithm>
-#include <cassert>
-
-#include "nodes.h"
-#include "osm.h"
-#include "tinyxml2.h"
-
-using namespace std;
-using namespace tinyxml2;
-
-
-//
-// readMapNodes
-//
-// Given an XML document, reads through the document and 
-// stores all the nodes into the given vector. Each node
-// is a point on the map, with a unique id along with 
-// (lat, lon) position. Some nodes are entrances to buildings,
-// which we capture as well.
-//
-void Nodes::readMapNodes(XMLDocument& xmldoc)
-{
-  XMLElement* osm = xmldoc.FirstChildElement("osm");
-  assert(osm != nullptr);
-
-  //
-  // Parse the XML document node by node: 
-  //
-  XMLElement* node = osm->FirstChildElement("node");
-
-  while (node != nullptr)
-  {
-    const XMLAttribute* attrId = node->FindAttribute("id");
-    const XMLAttribute* attrLat = node->FindAttribute("lat");
-    const XMLAttribute* attrLon = node->FindAttribute("lon");
-
-    assert(attrId != nullptr);
-    assert(attrLat != nullptr);
-    assert(attrLon != nullptr);
-
-    long long id = attrId->Int64Value();
-    double latitude = attrLat->DoubleValue();
-    double longitude = attrLon->DoubleValue();
-
-    //
-    // is this node an entrance? Check for a 
-    // standard entrance, the main entrance, or
-    // one-way entrance.
-    //
-    bool isEntrance = false;
-
-    if (osmContainsKeyValue(node, "entrance", "yes") ||
-      osmContainsKeyValue(node, "entrance", "main") ||
-      osmContainsKeyValue(node, "entrance", "entrance"))
-    {
-      isEntrance = true;
-    }
-
-    //
-    // Add node to vector:
-    // 
-    // This creates an object then pushes copy into vector:
-    //
-    //   Node N(id, latitude, longitude, entrance);
-    //   this->MapNodes.push_back(N);
-    //
-    // This creates just one object "emplace":
-    //
-    this->MapNodes.emplace_back(id, latitude, longitude, isEntrance);
-
-    //
-    // next node element in the XML doc:
-    //
-    node = node->NextSiblingElement("node");
-  }
-}
-
-//
-// find
-// 
-// Searches the nodes for the one with the matching ID, returning
-// true if found and false if not. If found, a copy of the node 
-// is returned via the node parameter, which is passed by reference.
-//
-bool Nodes::find(long long id, double& lat, double& lon, bool& isEntrance) const
-{
-  //
-  // linear search:
-  //
-  // for (Node N : this->MapNodes)
-  // {
-  //   if (N.getID() == id) {
-  //     lat = N.getLat();
-  //     lon = N.getLon();
-  //     isEntrance = N.getIsEntrance();
-
-  //     return true;
-  //   }
-  // }
-//
-//
-// binary search: jump in the middle, and if not found, search to
-// the left if the element is smaller or to the right if bigger.
-  int low = 0;
-  int high = (int)this->MapNodes.size() - 1;
-  while (low <= high) {
-    int mid = low + ((high - low) / 2);
-    long long nodeid = this->MapNodes[mid].getID();
-    if (id == nodeid) { // found!
-      lat = this->MapNodes[mid].getLat();
-      lon = this->MapNodes[mid].getLon();
-      isEntrance = this->MapNodes[mid].getIsEntrance();
-      return true;
-  }
-    else if (id < nodeid) { // search left:
-      high = mid - 1;
-    }
-    else { // search right:
-      low = mid + 1;
-    }
-  }//while
-  //
-  // if get here, not found:
-  //
-  return false;
-}
-
-//
-// accessors / getters
-//
-int Nodes::getNumMapNodes() const {
-  return (int) this->MapNodes.size();
-}
+/*nodes.cpp*/
+
+//
+// A collection of nodes in the Open Street Map.
+// References:
+// 
+// TinyXML: 
+//   files: https://github.com/leethomason/tinyxml2
+//   docs:  http://leethomason.github.io/tinyxml2/
+// 
+// OpenStreetMap: https://www.openstreetmap.org
+// OpenStreetMap docs:  
+//   https://wiki.openstreetmap.org/wiki/Main_Page
+//   https://wiki.openstreetmap.org/wiki/Map_Features
+//   https://wiki.openstreetmap.org/wiki/Node
+//   https://wiki.openstreetmap.org/wiki/Way
+//   https://wiki.openstreetmap.org/wiki/Relation
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+#include "nodes.h"
+#include "numparse.h"
+#include "osm.h"
+#include "parallel.h"
+#include "tinyxml2.h"
+
+using namespace std;
+using namespace tinyxml2;
+
+
+Nodes::Nodes()
+  : IndexKind(NodeIndexKind::SORTED), ActiveIndex(NodeIndexKind::SORTED)
+{
+}
+
+
+//
+// readMapNodes
+//
+// Given an XML document, reads through the document and 
+// stores all the nodes into the given vector. Each node
+// is a point on the map, with a unique id along with 
+// (lat, lon) position. Some nodes are entrances to buildings,
+// which we capture as well.
+//
+void Nodes::readMapNodes(XMLDocument& xmldoc)
+{
+  XMLElement* osm = xmldoc.FirstChildElement("osm");
+  assert(osm != nullptr);
+
+  //
+  // Parse the XML document node by node: 
+  //
+  XMLElement* node = osm->FirstChildElement("node");
+
+  while (node != nullptr)
+  {
+    const XMLAttribute* attrId = node->FindAttribute("id");
+    const XMLAttribute* attrLat = node->FindAttribute("lat");
+    const XMLAttribute* attrLon = node->FindAttribute("lon");
+
+    assert(attrId != nullptr);
+    assert(attrLat != nullptr);
+    assert(attrLon != nullptr);
+
+    long long id;
+    double latitude, longitude;
+
+    parseInt64(attrId->Value(), id);
+    parseCoordinate(attrLat->Value(), latitude);
+    parseCoordinate(attrLon->Value(), longitude);
+
+    //
+    // is this node an entrance? Check for a 
+    // standard entrance, the main entrance, or
+    // one-way entrance.
+    //
+    bool isEntrance = false;
+
+    if (osmContainsKeyValue(node, "entrance", "yes") ||
+      osmContainsKeyValue(node, "entrance", "main") ||
+      osmContainsKeyValue(node, "entrance", "entrance"))
+    {
+      isEntrance = true;
+    }
+
+    this->add(id, latitude, longitude, isEntrance);
+
+    //
+    // next node element in the XML doc:
+    //
+    node = node->NextSiblingElement("node");
+  }
+
+  //
+  // find needs the nodes sorted, whatever order the file was in:
+  //
+  this->ensureOrder(defaultThreadCount());
+}
+
+//
+// setEntrance
+//
+// Sets bit i of the entrance bitset.
+//
+void Nodes::setEntrance(size_t i, bool isEntrance)
+{
+  vector<uint64_t>& bits = this->EntranceBits.edit();
+
+  if (i / 64 >= bits.size())
+  {
+    bits.resize(i / 64 + 1, 0);
+  }
+
+  uint64_t bit = (uint64_t) 1 << (i % 64);
+
+  if (isEntrance)
+    bits[i / 64] |= bit;
+  else
+    bits[i / 64] &= ~bit;
+}
+
+//
+// add
+//
+// Adds one node to the end of the collection.
+//
+void Nodes::add(long long id, double lat, double lon, bool isEntrance)
+{
+  if (this->ActiveIndex != NodeIndexKind::SORTED)
+  {
+    this->clearIndex();
+  }
+
+  NodeStats::countAdded(1);
+
+  this->IDs.edit().push_back(id);
+  this->Lats.edit().push_back(toFixedCoord(lat));
+  this->Lons.edit().push_back(toFixedCoord(lon));
+  this->setEntrance(this->IDs.size() - 1, isEntrance);
+}
+
+//
+// append
+//
+// Adds all of the other collection's nodes to the end of this one.
+// This collection is unpacked first, so its id column is complete;
+// if the other one is packed, its ids are decoded from its index.
+// The nodes were counted as added when added to the other, so they
+// are not counted again.
+//
+void Nodes::append(const Nodes& other)
+{
+  this->clearIndex();
+
+  size_t start = this->IDs.size();
+  size_t count = other.Lats.size();
+
+  vector<long long>& ids = this->IDs.edit();
+  vector<int32_t>& lats = this->Lats.edit();
+  vector<int32_t>& lons = this->Lons.edit();
+
+  if (other.ActiveIndex == NodeIndexKind::PACKED)
+  {
+    vector<long long> otherIDs;
+    other.Packed.unpack(otherIDs);
+    ids.insert(ids.end(), otherIDs.begin(), otherIDs.end());
+  }
+  else
+  {
+    ids.insert(ids.end(), other.IDs.begin(), other.IDs.end());
+  }
+  lats.insert(lats.end(), other.Lats.begin(), other.Lats.end());
+  lons.insert(lons.end(), other.Lons.begin(), other.Lons.end());
+
+  this->EntranceBits.edit().resize((ids.size() + 63) / 64, 0);
+  for (size_t i = 0; i < count; i++)
+  {
+    if (other.isEntrance(i))
+    {
+      this->setEntrance(start + i, true);
+    }
+  }
+}
+
+//
+// ensureOrder
+//
+// One scan counts the nodes out of order and the repeated IDs next to
+// each other. Only if some node is out of order is a permutation
+// sorted, stably, so repeated IDs stay in the order they were added
+// and the last of each run can be kept when the columns are gathered
+// in the new order.
+//
+// A hash index is built straight over the columns instead, and any
+// repeated IDs it finds are removed.
+//
+NodeOrder Nodes::ensureOrder(int numThreads)
+{
+  this->clearIndex();
+
+  NodeOrder order;
+  const Column<long long>& ids = this->IDs;
+  size_t n = ids.size();
+  long long numAdjacentDuplicates = 0;
+
+  for (size_t i = 1; i < n; i++)
+  {
+    if (ids[i] < ids[i - 1])
+      order.NumOutOfOrder++;
+    else if (ids[i] == ids[i - 1])
+      numAdjacentDuplicates++;
+  }
+
+  if (this->IndexKind == NodeIndexKind::HASH)
+  {
+    vector<size_t> repeated;
+    this->Hash.build(ids.view(), repeated);
+
+    if (!repeated.empty())
+    {
+      this->removeRows(repeated);
+      this->Hash.build(ids.view(), repeated);
+    }
+
+    order.NumDuplicates = (long long) (n - ids.size());
+    this->ActiveIndex = NodeIndexKind::HASH;
+    return order;
+  }
+
+  if (order.NumOutOfOrder == 0 && numAdjacentDuplicates == 0)
+  {
+    this->buildIndex();
+    return order;
+  }
+
+  vector<size_t> permutation(n);
+  for (size_t i = 0; i < n; i++)
+  {
+    permutation[i] = i;
+  }
+
+  if (order.NumOutOfOrder > 0)
+  {
+    const long long* idData = ids.data();
+    parallelSort(permutation,
+      [idData](size_t i1, size_t i2) { return idData[i1] < idData[i2]; },
+      numThreads);
+    order.Sorted = true;
+  }
+
+  //
+  // gather the columns in sorted order, keeping the last node of each
+  // run with the same ID (not through add, which would count the
+  // nodes as added again):
+  //
+  Nodes sorted;
+  vector<long long>& sortedIDs = sorted.IDs.edit();
+  vector<int32_t>& sortedLats = sorted.Lats.edit();
+  vector<int32_t>& sortedLons = sorted.Lons.edit();
+
+  sortedIDs.reserve(n);
+  sortedLats.reserve(n);
+  sortedLons.reserve(n);
+  sorted.EntranceBits.edit().reserve((n + 63) / 64);
+
+  for (size_t i : permutation)
+  {
+    size_t kept = sortedIDs.size();
+
+    if (kept > 0 && sortedIDs[kept - 1] == ids[i])
+    {
+      sortedLats[kept - 1] = this->Lats[i];
+      sortedLons[kept - 1] = this->Lons[i];
+      sorted.setEntrance(kept - 1, this->isEntrance(i));
+    }
+    else
+    {
+      sortedIDs.push_back(ids[i]);
+      sortedLats.push_back(this->Lats[i]);
+      sortedLons.push_back(this->Lons[i]);
+      sorted.setEntrance(kept, this->isEntrance(i));
+    }
+  }
+
+  order.NumDuplicates = (long long) (n - sortedIDs.size());
+
+  sorted.IndexKind = this->IndexKind;
+  *this = std::move(sorted);
+
+  this->buildIndex();
+  return order;
+}
+
+//
+// removeRows
+//
+// Removes the nodes at the given (ascending) positions, keeping the
+// rest in order.
+//
+void Nodes::removeRows(const vector<size_t>& rows)
+{
+  vector<long long>& ids = this->IDs.edit();
+  vector<int32_t>& lats = this->Lats.edit();
+  vector<int32_t>& lons = this->Lons.edit();
+  size_t kept = 0;
+  size_t r = 0;
+
+  for (size_t i = 0; i < ids.size(); i++)
+  {
+    if (r < rows.size() && rows[r] == i)
+    {
+      r++;
+      continue;
+    }
+
+    ids[kept] = ids[i];
+    lats[kept] = lats[i];
+    lons[kept] = lons[i];
+    this->setEntrance(kept, this->isEntrance(i));
+    kept++;
+  }
+
+  ids.resize(kept);
+  lats.resize(kept);
+  lons.resize(kept);
+  this->EntranceBits.edit().resize((kept + 63) / 64);
+}
+
+//
+// setIndexKind / buildIndex / clearIndex
+//
+// buildIndex builds the selected index over nodes already in order;
+// packing frees the id column, and clearIndex unpacks it back.
+//
+void Nodes::setIndexKind(NodeIndexKind kind)
+{
+  this->IndexKind = kind;
+}
+
+void Nodes::buildIndex()
+{
+  this->clearIndex();
+
+  if (this->IndexKind == NodeIndexKind::EYTZINGER)
+  {
+    this->Eytzinger.build(this->IDs.view());
+  }
+  else if (this->IndexKind == NodeIndexKind::HASH)
+  {
+    vector<size_t> repeated;
+    this->Hash.build(this->IDs.view(), repeated);
+  }
+  else if (this->IndexKind == NodeIndexKind::PACKED)
+  {
+    this->Packed.build(this->IDs.view());
+    this->IDs = Column<long long>();
+  }
+
+  this->ActiveIndex = this->IndexKind;
+}
+
+void Nodes::clearIndex()
+{
+  if (this->ActiveIndex == NodeIndexKind::PACKED)
+  {
+    this->Packed.unpack(this->IDs.edit());
+  }
+
+  this->Packed.clear();
+  this->Eytzinger.clear();
+  this->Hash.clear();
+  this->ActiveIndex = NodeIndexKind::SORTED;
+}
+
+NodeIndexKind Nodes::getIndexKind() const
+{
+  return this->IndexKind;
+}
+
+//
+// findIndex
+//
+// Counts the lookup, and whether it missed (see nodestats.h).
+//
+bool Nodes::findIndex(long long id, size_t& index) const
+{
+  NodeStats::countLookup();
+
+  bool found = this->search(id, index);
+  if (!found)
+  {
+    NodeStats::countMiss();
+  }
+  return found;
+}
+
+NodeCounts Nodes::getCounts()
+{
+  return NodeStats::read();
+}
+
+//
+// search
+//
+// Looks the ID up in the index, or binary-searches the id column if
+// there is none.
+//
+bool Nodes::search(long long id, size_t& index) const
+{
+  if (this->ActiveIndex == NodeIndexKind::EYTZINGER)
+  {
+    return this->Eytzinger.find(id, index);
+  }
+  else if (this->ActiveIndex == NodeIndexKind::HASH)
+  {
+    return this->Hash.find(id, index);
+  }
+  else if (this->ActiveIndex == NodeIndexKind::PACKED)
+  {
+    return this->Packed.find(id, index);
+  }
+
+  auto it = lower_bound(this->IDs.begin(), this->IDs.end(), id);
+
+  if (it == this->IDs.end() || *it != id)
+  {
+    return false;
+  }
+
+  index = (size_t) (it - this->IDs.begin());
+  return true;
+}
+
+//
+// find
+//
+// Searches the nodes for the one with the matching ID, returning
+// true if found and false if not. If found, the node's position and
+// entrance flag are returned via the reference parameters.
+//
+bool Nodes::find(long long id, double& lat, double& lon, bool& isEntrance) const
+{
+  size_t i;
+
+  if (!this->findIndex(id, i))
+  {
+    return false;
+  }
+
+  lat = this->getLat(i);
+  lon = this->getLon(i);
+  isEntrance = this->isEntrance(i);
+  return true;
+}
+
+//
+// accessors / getters
+//
+int Nodes::getNumMapNodes() const {
+  return (int) this->Lats.size();
+}
+
+size_t Nodes::getMemoryUsage() const {
+  return this->IDs.getMemoryUsage()
+    + this->Lats.getMemoryUsage()
+    + this->Lons.getMemoryUsage()
+    + this->EntranceBits.getMemoryUsage()
+    + this->Eytzinger.getMemoryUsage()
+    + this->Hash.getMemoryUsage()
+    + this->Packed.getMemoryUsage();
+}
@@ -0,0 +1,78 @@
+/*nodestats.cpp*/
+
+//
+// Instrumentation counters for Nodes (diagnostic builds).
+//
+
+#include <vector>
+#include <mutex>
+#include <algorithm>
+
+#include "nodestats.h"
+
+using namespace std;
+
+
+//
+// Registry
+//
+// The counters of every running thread, plus the totals of threads
+// that have finished. Only touched when a thread first counts, when
+// it exits, and on read; counting itself never locks.
+//
+struct Registry
+{
+  mutex Lock;
+  vector<ThreadNodeStats::Counters*> Live;
+  NodeCounts Finished;
+};
+
+static Registry& registry()
+{
+  static Registry r;
+  return r;
+}
+
+
+ThreadNodeStats::Counters::Counters()
+  : Added(0), Lookups(0), Misses(0)
+{
+  Registry& r = registry();
+  lock_guard<mutex> guard(r.Lock);
+
+  r.Live.push_back(this);
+}
+
+ThreadNodeStats::Counters::~Counters()
+{
+  Registry& r = registry();
+  lock_guard<mutex> guard(r.Lock);
+
+  r.Finished.Added += this->Added.load(memory_order_relaxed);
+  r.Finished.Lookups += this->Lookups.load(memory_order_relaxed);
+  r.Finished.Misses += this->Misses.load(memory_order_relaxed);
+
+  r.Live.erase(remove(r.Live.begin(), r.Live.end(), this), r.Live.end());
+}
+
+//
+// read
+//
+// Totals of finished threads plus the current counts of live ones.
+//
+NodeCounts ThreadNodeStats::read()
+{
+  Registry& r = registry();
+  lock_guard<mutex> guard(r.Lock);
+
+  NodeCounts total = r.Finished;
+
+  for (const Counters* c : r.Live)
+  {
+    total.Added += c->Added.load(memory_order_relaxed);
+    total.Lookups += c->Lookups.load(memory_order_relaxed);
+    total.Misses += c->Misses.load(memory_order_relaxed);
+  }
+
+  return total;
+}
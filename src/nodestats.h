@@ -0,0 +1,116 @@
+/*nodestats.h*/
+
+//
+// Instrumentation counters for Nodes: how many nodes are added, and
+// how many lookups by ID (Nodes::findIndex) are made and how many of
+// them miss.
+//
+// The counters are a compile-time policy, selected with NODE_STATS:
+//
+//   - production builds (the default) use NoNodeStats, whose counting
+//     functions are empty and inline, so they compile to nothing and
+//     Nodes::findIndex pays nothing for them;
+//
+//   - diagnostic builds (-DNODE_STATS, e.g. make build-api STATS=1)
+//     use ThreadNodeStats: each thread counts into counters of its
+//     own, so counting needs no lock and threads never write to the
+//     same cache line, and reading adds up every thread's counters
+//     (including those of threads that have finished).
+//
+// Either way, NodeStats::read() returns the totals; NodeStats::Enabled
+// tells whether they were counted at all.
+//
+
+#pragma once
+
+#include <atomic>
+
+using namespace std;
+
+
+//
+// NodeCounts
+//
+// A snapshot of the counters.
+//
+struct NodeCounts
+{
+  long long Added;  // once per node read from a map or snapshot
+  long long Lookups;
+  long long Misses;
+
+  NodeCounts()
+    : Added(0), Lookups(0), Misses(0)
+  {
+  }
+};
+
+
+//
+// NoNodeStats
+//
+// Production policy: nothing is counted.
+//
+class NoNodeStats
+{
+public:
+  static constexpr bool Enabled = false;
+
+  static void countAdded(long long) {}
+  static void countLookup() {}
+  static void countMiss() {}
+
+  static NodeCounts read() { return NodeCounts(); }
+};
+
+
+//
+// ThreadNodeStats
+//
+// Diagnostic policy: per-thread counters, aggregated on read.
+//
+class ThreadNodeStats
+{
+public:
+  //
+  // one thread's counters; only that thread writes them, but read()
+  // loads them from another thread, hence relaxed atomics (a plain
+  // load and store on x86, no locked instruction):
+  //
+  struct Counters
+  {
+    atomic<long long> Added;
+    atomic<long long> Lookups;
+    atomic<long long> Misses;
+
+    Counters();   // registers the thread's counters
+    ~Counters();  // folds them into the totals of finished threads
+  };
+
+  static constexpr bool Enabled = true;
+
+  static void countAdded(long long n) { bump(local().Added, n); }
+  static void countLookup() { bump(local().Lookups, 1); }
+  static void countMiss() { bump(local().Misses, 1); }
+
+  static NodeCounts read();
+
+private:
+  static Counters& local()
+  {
+    thread_local Counters counters;
+    return counters;
+  }
+
+  static void bump(atomic<long long>& counter, long long n)
+  {
+    counter.store(counter.load(memory_order_relaxed) + n, memory_order_relaxed);
+  }
+};
+
+
+#ifdef NODE_STATS
+using NodeStats = ThreadNodeStats;
+#else
+using NodeStats = NoNodeStats;
+#endif
@@ -0,0 +1,134 @@
+/*numparse.h*/
+
+//
+// Fast parsing of the numbers in an Open Street Map file: node and
+// way ids, and coordinates.
+//
+// tinyxml2's Int64Value / DoubleValue go through sscanf, and strtod
+// needs a NUL-terminated copy of the text; both are locale-aware and
+// slow for the millions of numbers in a large extract. These parse
+// straight out of the text with std::from_chars, which never
+// allocates or looks at the locale.
+//
+// Coordinates get a fast path on top: OSM writes them as plain
+// decimals with at most 7 fractional digits ("42.0356152"). Such a
+// decimal is an integer n divided by 10^k; when n < 2^53 both n and
+// 10^k are exact doubles, so the one correctly rounded division n / 10^k
+// is exactly the double strtod would return. Anything else (exponents,
+// long mantissas) falls back to from_chars.
+//
+// Like strtod, parsing stops at the first character that is not part
+// of the number, and leading whitespace and a '+' sign are skipped.
+//
+// Reference:
+//
+//   W. D. Clinger, "How to Read Floating Point Numbers Accurately",
+//   PLDI 1990 (the exact fast path)
+//
+
+#pragma once
+
+#include <string_view>
+#include <charconv>
+#include <cstdint>
+
+using namespace std;
+
+
+//
+// skipNumberPrefix
+//
+// Skips leading whitespace and a '+' sign, which from_chars does not
+// accept but sscanf and strtod do.
+//
+inline const char* skipNumberPrefix(const char* p, const char* end)
+{
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+  {
+    p++;
+  }
+
+  if (p < end && *p == '+' && p + 1 < end && *(p + 1) != '-')
+  {
+    p++;
+  }
+
+  return p;
+}
+
+//
+// parseInt64
+//
+// Parses a decimal integer (e.g. an id) from the start of text.
+// Returns false, with value 0, if text does not start with one.
+//
+inline bool parseInt64(string_view text, long long& value)
+{
+  const char* end = text.data() + text.size();
+  const char* p = skipNumberPrefix(text.data(), end);
+
+  value = 0;
+  return from_chars(p, end, value).ec == errc();
+}
+
+//
+// parseCoordinate
+//
+// Parses a decimal number (e.g. a latitude) from the start of text.
+// Returns false, with value 0.0, if text does not start with one.
+//
+inline bool parseCoordinate(string_view text, double& value)
+{
+  static const double POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+
+  const char* end = text.data() + text.size();
+  const char* start = skipNumberPrefix(text.data(), end);
+  const char* p = start;
+
+  bool negative = (p < end && *p == '-');
+  if (negative)
+  {
+    p++;
+  }
+
+  //
+  // fast path: [-]digits[.digits], at most 15 digits in all
+  //
+  uint64_t n = 0;
+  int numDigits = 0;
+  int numFraction = 0;
+  bool sawPoint = false;
+
+  for (; p < end; p++)
+  {
+    if (*p >= '0' && *p <= '9')
+    {
+      n = n * 10 + (uint64_t) (*p - '0');
+      numDigits++;
+      numFraction += sawPoint ? 1 : 0;
+    }
+    else if (*p == '.' && !sawPoint)
+    {
+      sawPoint = true;
+    }
+    else
+    {
+      break;
+    }
+  }
+
+  bool hasExponent = (p < end && (*p == 'e' || *p == 'E'));
+
+  if (numDigits > 0 && numDigits <= 15 && !hasExponent)
+  {
+    double result = (double) n / POW10[numFraction];
+    value = negative ? -result : result;
+    return true;
+  }
+
+  value = 0.0;
+  return from_chars(start, end, value).ec == errc();
+}
@@ -23,6 +23,7 @@
 #include <cassert>
 
 #include "osm.h"
+#include "mapinput.h"
 
 using namespace std;
 using namespace tinyxml2;
@@ -35,14 +36,50 @@ using namespace tinyxml2;
 // that file into the given xmldoc variable (which is passed
 // by reference). Returns true if successful, false if the 
 // file could not be opened OR the file does not contain 
-// an Open Street Map document.
+// an Open Street Map document. A gzip- or zstd-compressed
+// file is decompressed as it is read.
 //
 bool osmLoadMapFile(string filename, XMLDocument& xmldoc)
 {
   //
   // load the XML document:
   //
-  xmldoc.LoadFile(filename.c_str());
+  if (MapInput::detectCompression(filename) == MapInput::NONE)
+  {
+    xmldoc.LoadFile(filename.c_str());
+  }
+  else
+  {
+    //
+    // the document needs all of the text, so decompress it into
+    // memory (tinyxml2 reads a plain file into memory too):
+    //
+    MapInput input;
+    string text;
+
+    if (!input.open(filename))
+    {
+      if (!input.Error)  // else the decompressor said why
+      {
+        cout << "**ERROR: unable to open XML file '" << filename << "'." << endl;
+      }
+      return false;
+    }
+
+    char buffer[1 << 16];
+    size_t n;
+    while ((n = input.read(buffer, sizeof(buffer))) > 0)
+    {
+      text.append(buffer, n);
+    }
+
+    if (input.Error)
+    {
+      return false;
+    }
+
+    xmldoc.Parse(text.data(), text.size());
+  }
 
   if (xmldoc.ErrorID() != 0)  // failed:
   {
@@ -92,12 +129,12 @@ bool osmContainsKeyValue(XMLElement* e, string key, string value)
     const XMLAttribute* keyAttribute = tag->FindAttribute("k");
     const XMLAttribute* valueAttribute = tag->FindAttribute("v");
 
+    //
+    // compare in place, without copying the attributes into strings:
+    //
     if (keyAttribute != nullptr && valueAttribute != nullptr)
     {
-      string elemkey(keyAttribute->Value());
-      string elemvalue(valueAttribute->Value());
-
-      if (elemkey == key && elemvalue == value)  // found it:
+      if (key == keyAttribute->Value() && value == valueAttribute->Value())  // found it:
       {
         return true;
       }
@@ -143,9 +180,7 @@ string osmGetKeyValue(XMLElement* e, string key)
 
     if (keyAttribute != nullptr && valueAttribute != nullptr)
     {
-      string elemkey(keyAttribute->Value());
-      
-      if (elemkey == key)  // found it:
+      if (key == keyAttribute->Value())  // found it:
       {
         string elemvalue(valueAttribute->Value());
 
@@ -0,0 +1,732 @@
+/*osmpbf.cpp*/
+
+//
+// Reader for Open Street Map PBF files (.osm.pbf).
+//
+// Only the parts of the format the map model needs are decoded: node
+// ids, coordinates and tags (plain and dense), and way ids, tags and
+// node refs. Metadata (versions, users, timestamps) and relations are
+// skipped.
+//
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+#include <zlib.h>
+
+#include "osmpbf.h"
+
+using namespace std;
+
+
+//
+// limits from the PBF specification:
+//
+static const uint32_t MAX_BLOB_HEADER_SIZE = 64 * 1024;
+static const uint32_t MAX_BLOB_SIZE = 32 * 1024 * 1024;
+
+
+//
+// ProtoReader
+//
+// Walks the fields of one protobuf message. Any read past the end of
+// the message sets Error rather than reading out of bounds.
+//
+struct ProtoReader
+{
+  const uint8_t* P;
+  const uint8_t* End;
+  bool Error;
+
+  ProtoReader(string_view data)
+    : P((const uint8_t*) data.data()), End((const uint8_t*) data.data() + data.size()), Error(false)
+  {
+  }
+
+  bool atEnd() const
+  {
+    return this->P >= this->End || this->Error;
+  }
+
+  uint64_t varint()
+  {
+    uint64_t result = 0;
+
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+      if (this->P >= this->End)
+      {
+        break;
+      }
+
+      uint8_t byte = *this->P++;
+      result |= (uint64_t) (byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0)
+      {
+        return result;
+      }
+    }
+
+    this->Error = true;
+    return 0;
+  }
+
+  //
+  // zig-zag encoded signed varint (sint32 / sint64):
+  //
+  int64_t svarint()
+  {
+    uint64_t n = this->varint();
+    return (int64_t) (n >> 1) ^ -(int64_t) (n & 1);
+  }
+
+  string_view bytes()
+  {
+    uint64_t length = this->varint();
+
+    if (this->Error || length > (uint64_t) (this->End - this->P))
+    {
+      this->Error = true;
+      return string_view();
+    }
+
+    string_view result((const char*) this->P, length);
+    this->P += length;
+    return result;
+  }
+
+  //
+  // next
+  //
+  // Reads the next field key. Returns false at the end of the message.
+  //
+  bool next(uint32_t& field, uint32_t& wireType)
+  {
+    if (this->atEnd())
+    {
+      return false;
+    }
+
+    uint64_t key = this->varint();
+    field = (uint32_t) (key >> 3);
+    wireType = (uint32_t) (key & 7);
+    return !this->Error;
+  }
+
+  //
+  // skip
+  //
+  // Skips the value of a field we do not need.
+  //
+  void skip(uint32_t wireType)
+  {
+    switch (wireType)
+    {
+      case 0: this->varint(); break;
+      case 1: this->advance(8); break;
+      case 2: this->bytes(); break;
+      case 5: this->advance(4); break;
+      default: this->Error = true; break;
+    }
+  }
+
+  void advance(size_t n)
+  {
+    if (n > (size_t) (this->End - this->P))
+    {
+      this->Error = true;
+      return;
+    }
+    this->P += n;
+  }
+};
+
+
+//
+// PackedReader
+//
+// Iterates over the values of a packed repeated varint field.
+//
+struct PackedReader
+{
+  ProtoReader Reader;
+
+  PackedReader(string_view data)
+    : Reader(data)
+  {
+  }
+
+  bool more() const { return !this->Reader.atEnd(); }
+  uint64_t next() { return this->Reader.varint(); }
+  int64_t nextSigned() { return this->Reader.svarint(); }
+};
+
+
+//
+// PbfReader
+//
+bool PbfReader::open(string filename)
+{
+  this->Filename = filename;
+  return this->File.open(filename);
+}
+
+//
+// nextBlob
+//
+// Each blob is preceded by a 4-byte big-endian length and a
+// BlobHeader message giving its type and size.
+//
+bool PbfReader::nextBlob(PbfBlob& blob)
+{
+  unsigned char lengthBytes[4];
+  size_t n = this->File.read((char*) lengthBytes, 4);
+
+  if (n == 0)
+  {
+    this->Error = this->File.Error;  // else end of file
+    return false;
+  }
+
+  if (n < 4 && !this->File.readFully((char*) lengthBytes + n, 4 - n))
+  {
+    this->Error = true;  // partial length at end of file
+    return false;
+  }
+
+  uint32_t headerLength = ((uint32_t) lengthBytes[0] << 24) | ((uint32_t) lengthBytes[1] << 16)
+    | ((uint32_t) lengthBytes[2] << 8) | (uint32_t) lengthBytes[3];
+
+  if (headerLength > MAX_BLOB_HEADER_SIZE)
+  {
+    this->Error = true;
+    return false;
+  }
+
+  string header(headerLength, '\0');
+  if (!this->File.readFully(&header[0], headerLength))
+  {
+    this->Error = true;
+    return false;
+  }
+
+  //
+  // BlobHeader: type = 1, indexdata = 2, datasize = 3
+  //
+  ProtoReader reader(header);
+  uint32_t field, wireType;
+  uint64_t dataSize = 0;
+
+  blob.Type.clear();
+  while (reader.next(field, wireType))
+  {
+    if (field == 1 && wireType == 2)
+      blob.Type = string(reader.bytes());
+    else if (field == 3 && wireType == 0)
+      dataSize = reader.varint();
+    else
+      reader.skip(wireType);
+  }
+
+  if (reader.Error || dataSize > MAX_BLOB_SIZE)
+  {
+    this->Error = true;
+    return false;
+  }
+
+  blob.Data.resize(dataSize);
+  if (dataSize > 0 && !this->File.readFully(&blob.Data[0], dataSize))
+  {
+    this->Error = true;
+    return false;
+  }
+
+  return true;
+}
+
+
+//
+// unpackBlob
+//
+// Returns the uncompressed contents of a Blob message: raw = 1,
+// raw_size = 2, zlib_data = 3 (lzma, lz4 and zstd are not supported).
+//
+static bool unpackBlob(const string& data, string& out, string& error)
+{
+  ProtoReader reader(data);
+  uint32_t field, wireType;
+  uint64_t rawSize = 0;
+  string_view raw, zlibData;
+  bool haveRaw = false, haveZlib = false;
+
+  while (reader.next(field, wireType))
+  {
+    if (field == 1 && wireType == 2)
+    {
+      raw = reader.bytes();
+      haveRaw = true;
+    }
+    else if (field == 2 && wireType == 0)
+    {
+      rawSize = reader.varint();
+    }
+    else if (field == 3 && wireType == 2)
+    {
+      zlibData = reader.bytes();
+      haveZlib = true;
+    }
+    else if (field >= 4 && field <= 7)
+    {
+      error = "unsupported blob compression";
+      return false;
+    }
+    else
+    {
+      reader.skip(wireType);
+    }
+  }
+
+  if (reader.Error)
+  {
+    error = "malformed blob";
+    return false;
+  }
+
+  if (haveRaw)
+  {
+    out.assign(raw.data(), raw.size());
+    return true;
+  }
+
+  if (!haveZlib || rawSize > MAX_BLOB_SIZE)
+  {
+    error = "malformed blob";
+    return false;
+  }
+
+  out.resize(rawSize);
+  uLongf outLength = (uLongf) rawSize;
+
+  int rc = uncompress((Bytef*) &out[0], &outLength,
+                      (const Bytef*) zlibData.data(), (uLong) zlibData.size());
+
+  if (rc != Z_OK || outLength != rawSize)
+  {
+    error = "zlib decompression failed";
+    return false;
+  }
+
+  return true;
+}
+
+
+//
+// checkHeader
+//
+// HeaderBlock: required_features = 4. Every feature a file requires
+// must be understood by the reader.
+//
+static bool checkHeader(string_view block, string& error)
+{
+  ProtoReader reader(block);
+  uint32_t field, wireType;
+
+  while (reader.next(field, wireType))
+  {
+    if (field == 4 && wireType == 2)
+    {
+      string_view feature = reader.bytes();
+
+      if (feature != "OsmSchema-V0.6" && feature != "DenseNodes")
+      {
+        error = "unsupported required feature '" + string(feature) + "'";
+        return false;
+      }
+    }
+    else
+    {
+      reader.skip(wireType);
+    }
+  }
+
+  if (reader.Error)
+  {
+    error = "malformed header block";
+    return false;
+  }
+
+  return true;
+}
+
+
+//
+// BlockContext
+//
+// What every group of a PrimitiveBlock needs to decode its elements:
+// the string table and the coordinate encoding.
+//
+struct BlockContext
+{
+  vector<string_view> Strings;
+  int64_t Granularity = 100;  // nanodegrees per unit
+  int64_t LatOffset = 0;      // nanodegrees
+  int64_t LonOffset = 0;
+
+  //
+  // coordinates in degrees; dividing the exact nanodegree count by
+  // 1e9 yields the same double as parsing the XML's decimal text
+  //
+  double lat(int64_t value) const
+  {
+    return (double) (this->LatOffset + this->Granularity * value) / 1e9;
+  }
+
+  double lon(int64_t value) const
+  {
+    return (double) (this->LonOffset + this->Granularity * value) / 1e9;
+  }
+
+  bool getString(uint64_t index, string_view& s) const
+  {
+    if (index >= this->Strings.size())
+    {
+      return false;
+    }
+    s = this->Strings[index];
+    return true;
+  }
+};
+
+
+//
+// addTags
+//
+// Adds the tags given as parallel key / value string-table indices.
+//
+static bool addTags(const BlockContext& context, string_view keys, string_view vals, OsmElement& element)
+{
+  PackedReader k(keys), v(vals);
+
+  while (k.more() && v.more())
+  {
+    string_view key, value;
+
+    if (!context.getString(k.next(), key) || !context.getString(v.next(), value))
+    {
+      return false;
+    }
+    element.Tags.emplace_back(key, value);
+  }
+
+  return !k.more() && !v.more() && !k.Reader.Error && !v.Reader.Error;
+}
+
+//
+// decodeNode
+//
+// Node: id = 1 (sint64), keys = 2, vals = 3, lat = 8, lon = 9.
+//
+static bool decodeNode(const BlockContext& context, string_view data, OsmElement& element, OsmHandler& handler)
+{
+  ProtoReader reader(data);
+  uint32_t field, wireType;
+  string_view keys, vals;
+
+  element.Type = OsmElement::NODE;
+  element.ID = 0;
+  element.Lat = 0.0;
+  element.Lon = 0.0;
+  element.Tags.clear();
+  element.NodeRefs.clear();
+
+  while (reader.next(field, wireType))
+  {
+    if (field == 1 && wireType == 0)      element.ID = reader.svarint();
+    else if (field == 2 && wireType == 2) keys = reader.bytes();
+    else if (field == 3 && wireType == 2) vals = reader.bytes();
+    else if (field == 8 && wireType == 0) element.Lat = context.lat(reader.svarint());
+    else if (field == 9 && wireType == 0) element.Lon = context.lon(reader.svarint());
+    else reader.skip(wireType);
+  }
+
+  if (reader.Error || !addTags(context, keys, vals, element))
+  {
+    return false;
+  }
+
+  handler.node(element);
+  return true;
+}
+
+//
+// decodeDenseNodes
+//
+// DenseNodes: id = 1, lat = 8, lon = 9 (packed sint64, each delta
+// coded against the previous node), keys_vals = 10 (packed string
+// indices: key, value, key, value, ..., 0 after each node's tags).
+//
+static bool decodeDenseNodes(const BlockContext& context, string_view data, OsmElement& element, OsmHandler& handler)
+{
+  ProtoReader reader(data);
+  uint32_t field, wireType;
+  string_view ids, lats, lons, keysVals;
+
+  while (reader.next(field, wireType))
+  {
+    if (field == 1 && wireType == 2)       ids = reader.bytes();
+    else if (field == 8 && wireType == 2)  lats = reader.bytes();
+    else if (field == 9 && wireType == 2)  lons = reader.bytes();
+    else if (field == 10 && wireType == 2) keysVals = reader.bytes();
+    else reader.skip(wireType);
+  }
+
+  if (reader.Error)
+  {
+    return false;
+  }
+
+  PackedReader id(ids), lat(lats), lon(lons), kv(keysVals);
+  int64_t lastID = 0, lastLat = 0, lastLon = 0;
+
+  element.Type = OsmElement::NODE;
+  element.NodeRefs.clear();
+
+  while (id.more())
+  {
+    if (!lat.more() || !lon.more())
+    {
+      return false;
+    }
+
+    lastID += id.nextSigned();
+    lastLat += lat.nextSigned();
+    lastLon += lon.nextSigned();
+
+    element.ID = lastID;
+    element.Lat = context.lat(lastLat);
+    element.Lon = context.lon(lastLon);
+    element.Tags.clear();
+
+    //
+    // this node's tags, up to the 0 terminator (no keys_vals at all
+    // means no node in the block has tags):
+    //
+    while (kv.more())
+    {
+      uint64_t k = kv.next();
+      if (k == 0)
+      {
+        break;
+      }
+
+      string_view key, value;
+      if (!kv.more() || !context.getString(k, key) || !context.getString(kv.next(), value))
+      {
+        return false;
+      }
+      element.Tags.emplace_back(key, value);
+    }
+
+    handler.node(element);
+  }
+
+  return !id.Reader.Error && !lat.Reader.Error && !lon.Reader.Error && !kv.Reader.Error;
+}
+
+//
+// decodeWay
+//
+// Way: id = 1 (int64), keys = 2, vals = 3, refs = 8 (packed sint64,
+// delta coded).
+//
+static bool decodeWay(const BlockContext& context, string_view data, OsmElement& element, OsmHandler& handler)
+{
+  ProtoReader reader(data);
+  uint32_t field, wireType;
+  string_view keys, vals, refs;
+
+  element.Type = OsmElement::WAY;
+  element.ID = 0;
+  element.Lat = 0.0;
+  element.Lon = 0.0;
+  element.Tags.clear();
+  element.NodeRefs.clear();
+
+  while (reader.next(field, wireType))
+  {
+    if (field == 1 && wireType == 0)      element.ID = (int64_t) reader.varint();
+    else if (field == 2 && wireType == 2) keys = reader.bytes();
+    else if (field == 3 && wireType == 2) vals = reader.bytes();
+    else if (field == 8 && wireType == 2) refs = reader.bytes();
+    else reader.skip(wireType);
+  }
+
+  if (reader.Error || !addTags(context, keys, vals, element))
+  {
+    return false;
+  }
+
+  PackedReader ref(refs);
+  int64_t lastRef = 0;
+
+  while (ref.more())
+  {
+    lastRef += ref.nextSigned();
+    element.NodeRefs.push_back(lastRef);
+  }
+
+  if (ref.Reader.Error)
+  {
+    return false;
+  }
+
+  handler.way(element);
+  return true;
+}
+
+//
+// decodePrimitiveBlock
+//
+// PrimitiveBlock: stringtable = 1, primitivegroup = 2 (repeated),
+// granularity = 17, lat_offset = 19, lon_offset = 20. The string
+// table and offsets are read first, since groups may come before
+// them in the message.
+//
+static bool decodePrimitiveBlock(string_view block, OsmHandler& handler, string& error)
+{
+  ProtoReader reader(block);
+  uint32_t field, wireType;
+  BlockContext context;
+  vector<string_view> groups;
+
+  while (reader.next(field, wireType))
+  {
+    if (field == 1 && wireType == 2)
+    {
+      //
+      // StringTable: s = 1 (repeated bytes)
+      //
+      ProtoReader table(reader.bytes());
+      uint32_t f, w;
+
+      while (table.next(f, w))
+      {
+        if (f == 1 && w == 2)
+          context.Strings.push_back(table.bytes());
+        else
+          table.skip(w);
+      }
+
+      if (table.Error)
+      {
+        error = "malformed string table";
+        return false;
+      }
+    }
+    else if (field == 2 && wireType == 2)
+      groups.push_back(reader.bytes());
+    else if (field == 17 && wireType == 0)
+      context.Granularity = (int64_t) reader.varint();
+    else if (field == 19 && wireType == 0)
+      context.LatOffset = (int64_t) reader.varint();
+    else if (field == 20 && wireType == 0)
+      context.LonOffset = (int64_t) reader.varint();
+    else
+      reader.skip(wireType);
+  }
+
+  if (reader.Error)
+  {
+    error = "malformed primitive block";
+    return false;
+  }
+
+  //
+  // PrimitiveGroup: nodes = 1, dense = 2, ways = 3, relations = 4
+  //
+  OsmElement element;
+
+  for (string_view group : groups)
+  {
+    ProtoReader g(group);
+    bool ok = true;
+
+    while (ok && g.next(field, wireType))
+    {
+      if (field == 1 && wireType == 2)
+        ok = decodeNode(context, g.bytes(), element, handler);
+      else if (field == 2 && wireType == 2)
+        ok = decodeDenseNodes(context, g.bytes(), element, handler);
+      else if (field == 3 && wireType == 2)
+        ok = decodeWay(context, g.bytes(), element, handler);
+      else
+        g.skip(wireType);
+    }
+
+    if (!ok || g.Error)
+    {
+      error = "malformed primitive group";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+//
+// pbfDecodeBlob
+//
+// Decompresses and decodes the given blob.
+//
+bool pbfDecodeBlob(const PbfBlob& blob, OsmHandler& handler, string& error)
+{
+  string data;
+
+  if (!unpackBlob(blob.Data, data, error))
+  {
+    return false;
+  }
+
+  if (blob.Type == "OSMHeader")
+  {
+    return checkHeader(data, error);
+  }
+
+  if (blob.Type == "OSMData")
+  {
+    return decodePrimitiveBlock(data, handler, error);
+  }
+
+  return true;  // unknown blob types are to be skipped
+}
+
+
+//
+// isPbfFile
+//
+// A PBF file starts with the length of the first BlobHeader, whose
+// first field is the type string "OSMHeader". The file may itself be
+// compressed.
+//
+bool isPbfFile(string filename)
+{
+  if (!MapInput::isSupported(MapInput::detectCompression(filename)))
+  {
+    return false;
+  }
+
+  MapInput input;
+  char start[15];
+
+  if (!input.open(filename) || !input.readFully(start, sizeof(start)))
+  {
+    return false;
+  }
+
+  return start[4] == 0x0A && start[5] == 9 && memcmp(start + 6, "OSMHeader", 9) == 0;
+}
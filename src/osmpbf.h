@@ -0,0 +1,95 @@
+/*osmpbf.h*/
+
+//
+// Reader for Open Street Map PBF files (.osm.pbf).
+//
+// A PBF file is a sequence of blobs, each a protobuf message that is
+// usually zlib-compressed. The first blob is an OSMHeader; every other
+// one is an OSMData blob holding a PrimitiveBlock of a few thousand
+// nodes, ways and relations, with all of the block's strings (tag keys
+// and values) stored once in a string table. Nodes are mostly stored
+// "dense": ids and coordinates as deltas from the previous node.
+//
+// Blobs are independent of one another, so reading is split in two:
+// PbfReader pulls the raw blobs out of the file in order, and
+// pbfDecodeBlob decompresses and decodes one blob, which can happen on
+// any thread. Decoded elements are handed to an OsmHandler just like
+// the XML reader's (see osmstream.h).
+//
+// References:
+//
+//   https://wiki.openstreetmap.org/wiki/PBF_Format
+//   https://github.com/openstreetmap/OSM-binary (fileformat.proto, osmformat.proto)
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "osmstream.h"
+#include "mapinput.h"
+
+using namespace std;
+
+
+//
+// PbfBlob
+//
+// One blob from the file, still encoded: its type ("OSMHeader" or
+// "OSMData") and the bytes of its Blob message.
+//
+struct PbfBlob
+{
+  string Type;
+  string Data;
+};
+
+
+//
+// PbfReader
+//
+// Reads the blobs of a PBF file one at a time, in file order.
+//
+class PbfReader
+{
+private:
+  MapInput File;  // decompressed if the whole file is gzip/zstd
+  string Filename;
+
+public:
+  //
+  // open
+  //
+  // Opens the given file. Returns false if it cannot be opened.
+  //
+  bool open(string filename);
+
+  //
+  // nextBlob
+  //
+  // Reads the next blob into the given PbfBlob. Returns false at end
+  // of file, or on a read error (in which case Error is set).
+  //
+  bool nextBlob(PbfBlob& blob);
+
+  bool Error = false;
+};
+
+
+//
+// pbfDecodeBlob
+//
+// Decompresses and decodes the given blob, passing each node and way
+// in it to the handler (relations are skipped). OSMHeader blobs are
+// checked for features this reader does not support. Returns false
+// with a message in error if the blob cannot be decoded.
+//
+bool pbfDecodeBlob(const PbfBlob& blob, OsmHandler& handler, string& error);
+
+//
+// isPbfFile
+//
+// True if the given file starts like a PBF file (an OSMHeader blob),
+// once decompressed if it is gzip/zstd-compressed.
+//
+bool isPbfFile(string filename);
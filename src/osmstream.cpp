@@ -0,0 +1,797 @@
+/*osmstream.cpp*/
+
+//
+// Streaming reader for Open Street Map XML files.
+//
+// The reader is a small pull parser: it keeps a fixed-size window of
+// the file in memory, pulls one markup item ("<...>") at a time out of
+// it, and refills the window from the file when an item runs past the
+// end. Only the elements OSM files actually use are interpreted:
+// <osm>, <node>, <way>, <relation>, <nd> and <tag>; everything else
+// (bounds, members, comments, the XML declaration) is skipped.
+//
+// References:
+//
+// OpenStreetMap XML format:
+//   https://wiki.openstreetmap.org/wiki/OSM_XML
+//
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+
+#include "osmstream.h"
+#include "mapinput.h"
+#include "numparse.h"
+
+using namespace std;
+
+
+//
+// read the file this many bytes at a time:
+//
+static const size_t CHUNK_SIZE = 1 << 20;
+
+
+//
+// containsKeyValue / getKeyValue
+//
+bool OsmElement::containsKeyValue(string_view key, string_view value) const
+{
+  for (const auto& tag : this->Tags)
+  {
+    if (tag.first == key && tag.second == value)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+string_view OsmElement::getKeyValue(string_view key) const
+{
+  for (const auto& tag : this->Tags)
+  {
+    if (tag.first == key)
+    {
+      return tag.second;
+    }
+  }
+
+  return "";
+}
+
+
+//
+// appendUTF8
+//
+// Appends the given unicode code point to s, encoded as UTF-8.
+//
+static void appendUTF8(string& s, unsigned long cp)
+{
+  if (cp < 0x80)
+  {
+    s += (char) cp;
+  }
+  else if (cp < 0x800)
+  {
+    s += (char) (0xC0 | (cp >> 6));
+    s += (char) (0x80 | (cp & 0x3F));
+  }
+  else if (cp < 0x10000)
+  {
+    s += (char) (0xE0 | (cp >> 12));
+    s += (char) (0x80 | ((cp >> 6) & 0x3F));
+    s += (char) (0x80 | (cp & 0x3F));
+  }
+  else
+  {
+    s += (char) (0xF0 | (cp >> 18));
+    s += (char) (0x80 | ((cp >> 12) & 0x3F));
+    s += (char) (0x80 | ((cp >> 6) & 0x3F));
+    s += (char) (0x80 | (cp & 0x3F));
+  }
+}
+
+//
+// decodeValue
+//
+// Appends the raw attribute value [begin, end) to out, replacing
+// character and entity references (&amp; &#10; ...) by the characters
+// they stand for. Unknown references are copied through unchanged.
+//
+static void decodeValue(const char* begin, const char* end, string& out)
+{
+  const char* p = begin;
+  while (p < end)
+  {
+    const char* amp = (const char*) memchr(p, '&', end - p);
+    if (amp == nullptr)
+    {
+      out.append(p, end - p);
+      break;
+    }
+
+    out.append(p, amp - p);
+
+    const char* semi = (const char*) memchr(amp, ';', end - amp);
+    if (semi == nullptr)
+    {
+      out.append(amp, end - amp);
+      break;
+    }
+
+    string_view name(amp + 1, semi - amp - 1);
+
+    if (name == "amp")       out += '&';
+    else if (name == "lt")   out += '<';
+    else if (name == "gt")   out += '>';
+    else if (name == "quot") out += '"';
+    else if (name == "apos") out += '\'';
+    else if (name.size() > 1 && name[0] == '#')
+    {
+      bool hex = (name[1] == 'x' || name[1] == 'X');
+      unsigned long cp = 0;
+      for (char c : name.substr(hex ? 2 : 1))
+      {
+        int digit = isdigit((unsigned char) c) ? c - '0' : hex ? (tolower((unsigned char) c) - 'a' + 10) : -1;
+        if (digit < 0 || digit >= (hex ? 16 : 10))
+        {
+          break;
+        }
+        cp = cp * (hex ? 16 : 10) + digit;
+      }
+      appendUTF8(out, cp);
+    }
+    else
+    {
+      out.append(amp, semi + 1 - amp);
+    }
+
+    p = semi + 1;
+  }
+}
+
+
+//
+// OsmStreamReader
+//
+// Pulls markup items out of the file through a sliding window and
+// assembles them into OsmElements for the handler.
+//
+class OsmStreamReader
+{
+private:
+  MapInput Input;  // the file, decompressed if need be
+  vector<char> Buffer;
+  const char* Data;  // Buffer.data(), or the text when reading from memory
+  size_t Begin;      // start of unconsumed data in Data
+  size_t End;        // end of valid data in Data
+  bool Eof;
+
+  //
+  // the markup item last returned by nextItem(), without the
+  // surrounding < >:
+  //
+  const char* Item;
+  size_t ItemLength;
+
+  //
+  // attributes of the current item, as (name, raw value) ranges:
+  //
+  struct Attribute
+  {
+    const char* Name;
+    size_t NameLength;
+    const char* Value;
+    size_t ValueLength;
+  };
+  vector<Attribute> Attributes;
+
+  OsmElement Element;
+
+  //
+  // (key offset, key length, value offset, value length) of each tag
+  // of the current element within Element.TagText:
+  //
+  vector<size_t> TagBounds;
+
+  //
+  // fill
+  //
+  // Moves unconsumed data to the front of the buffer and reads more
+  // of the file after it, growing the buffer if an item is larger
+  // than a chunk. Returns false at end of file.
+  //
+  bool fill()
+  {
+    if (this->Eof)
+    {
+      return false;
+    }
+
+    size_t remaining = this->End - this->Begin;
+    memmove(this->Buffer.data(), this->Buffer.data() + this->Begin, remaining);
+    this->Begin = 0;
+    this->End = remaining;
+
+    if (this->Buffer.size() - this->End < CHUNK_SIZE)
+    {
+      this->Buffer.resize(this->End + CHUNK_SIZE);
+      this->Data = this->Buffer.data();
+    }
+
+    size_t n = this->Input.read(this->Buffer.data() + this->End, this->Buffer.size() - this->End);
+
+    this->End += n;
+    if (n == 0)
+    {
+      this->Eof = true;
+    }
+
+    return n > 0;
+  }
+
+  //
+  // findItemEnd
+  //
+  // Returns the offset of the '>' that closes the item starting at
+  // offset start (just after its '<'), or End if it is not in the
+  // buffer yet. Quoted attribute values may contain '>'; comments
+  // may contain anything up to "-->".
+  //
+  size_t findItemEnd(size_t start) const
+  {
+    const char* buf = this->Data;
+
+    if (this->End - start >= 3 && memcmp(buf + start, "!--", 3) == 0)
+    {
+      for (size_t i = start + 3; i + 2 < this->End; i++)
+      {
+        if (buf[i] == '-' && buf[i + 1] == '-' && buf[i + 2] == '>')
+        {
+          return i + 2;
+        }
+      }
+      return this->End;
+    }
+
+    char quote = 0;
+    for (size_t i = start; i < this->End; i++)
+    {
+      char c = buf[i];
+      if (quote != 0)
+      {
+        if (c == quote) quote = 0;
+      }
+      else if (c == '"' || c == '\'')
+      {
+        quote = c;
+      }
+      else if (c == '>')
+      {
+        return i;
+      }
+    }
+
+    return this->End;
+  }
+
+  //
+  // nextItem
+  //
+  // Advances to the next markup item, skipping any text in between.
+  // Returns false at end of file (or if the file ends inside an item,
+  // in which case Truncated is set).
+  //
+  bool nextItem()
+  {
+    size_t lt;
+    for (;;)
+    {
+      const char* p = (const char*) memchr(this->Data + this->Begin, '<', this->End - this->Begin);
+      if (p != nullptr)
+      {
+        lt = p - this->Data;
+        break;
+      }
+
+      this->Begin = this->End;  // only text, discard it
+      if (!this->fill())
+      {
+        return false;
+      }
+    }
+
+    size_t gt;
+    for (;;)
+    {
+      gt = this->findItemEnd(lt + 1);
+      if (gt < this->End)
+      {
+        break;
+      }
+
+      size_t offset = lt - this->Begin;
+      if (!this->fill())
+      {
+        this->Truncated = true;
+        return false;
+      }
+      lt = this->Begin + offset;
+    }
+
+    this->Item = this->Data + lt + 1;
+    this->ItemLength = gt - lt - 1;
+    this->Begin = gt + 1;
+
+    return true;
+  }
+
+  //
+  // parseAttributes
+  //
+  // Splits the current item (after its name) into attributes.
+  //
+  void parseAttributes(const char* p, const char* end)
+  {
+    this->Attributes.clear();
+
+    for (;;)
+    {
+      while (p < end && isspace((unsigned char) *p)) p++;
+
+      const char* name = p;
+      while (p < end && *p != '=' && !isspace((unsigned char) *p) && *p != '/') p++;
+      size_t nameLength = p - name;
+
+      while (p < end && isspace((unsigned char) *p)) p++;
+      if (nameLength == 0 || p >= end || *p != '=')
+      {
+        return;
+      }
+      p++;
+      while (p < end && isspace((unsigned char) *p)) p++;
+
+      if (p >= end || (*p != '"' && *p != '\''))
+      {
+        return;
+      }
+
+      char quote = *p++;
+      const char* value = p;
+      while (p < end && *p != quote) p++;
+      if (p >= end)
+      {
+        return;
+      }
+
+      this->Attributes.push_back({ name, nameLength, value, (size_t) (p - value) });
+      p++;
+    }
+  }
+
+  //
+  // findAttribute
+  //
+  // Returns the current item's attribute with the given name, or
+  // nullptr if it has none.
+  //
+  const Attribute* findAttribute(const char* name) const
+  {
+    size_t length = strlen(name);
+
+    for (const Attribute& a : this->Attributes)
+    {
+      if (a.NameLength == length && memcmp(a.Name, name, length) == 0)
+      {
+        return &a;
+      }
+    }
+
+    return nullptr;
+  }
+
+  //
+  // number conversions for attribute values, parsed in place (see
+  // numparse.h):
+  //
+  long long int64Attribute(const char* name)
+  {
+    const Attribute* a = this->findAttribute(name);
+    long long value = 0;
+
+    if (a == nullptr)
+    {
+      this->Malformed = true;
+      return 0;
+    }
+
+    parseInt64(string_view(a->Value, a->ValueLength), value);
+    return value;
+  }
+
+  double doubleAttribute(const char* name)
+  {
+    const Attribute* a = this->findAttribute(name);
+    double value = 0.0;
+
+    if (a == nullptr)
+    {
+      this->Malformed = true;
+      return 0.0;
+    }
+
+    parseCoordinate(string_view(a->Value, a->ValueLength), value);
+    return value;
+  }
+
+  //
+  // clearTags / finishTags
+  //
+  // Empties the tags before a new element, and points the element's
+  // tag views into TagText once all its tags have been read (TagText
+  // may move while it grows, so the views are only made at the end).
+  //
+  void clearTags()
+  {
+    this->Element.Tags.clear();
+    this->Element.TagText.clear();
+    this->TagBounds.clear();
+  }
+
+  void finishTags()
+  {
+    string_view text = this->Element.TagText;
+
+    for (size_t i = 0; i + 3 < this->TagBounds.size(); i += 4)
+    {
+      this->Element.Tags.emplace_back(text.substr(this->TagBounds[i], this->TagBounds[i + 1]),
+                                      text.substr(this->TagBounds[i + 2], this->TagBounds[i + 3]));
+    }
+  }
+
+public:
+  bool Truncated;
+  bool Malformed;
+
+  OsmStreamReader()
+    : Data(nullptr), Begin(0), End(0), Eof(false), Item(nullptr), ItemLength(0),
+      Truncated(false), Malformed(false)
+  {
+  }
+
+  bool open(const string& filename)
+  {
+    this->Buffer.resize(CHUNK_SIZE);
+    this->Data = this->Buffer.data();
+    return this->Input.open(filename);
+  }
+
+  //
+  // inputError
+  //
+  // True if the file could not be decompressed (already reported).
+  //
+  bool inputError() const
+  {
+    return this->Input.Error;
+  }
+
+  //
+  // openBuffer
+  //
+  // Reads from text already in memory instead of a file.
+  //
+  void openBuffer(const char* data, size_t size)
+  {
+    this->Data = data;
+    this->Begin = 0;
+    this->End = size;
+    this->Eof = true;
+  }
+
+  //
+  // run
+  //
+  // Streams the whole file through the handler. Returns false if no
+  // top-level <osm> element was found; a fragment (a run of elements
+  // from inside <osm>) needs none.
+  //
+  bool run(OsmHandler& handler, bool isFragment)
+  {
+    enum { OUTSIDE, IN_NODE, IN_WAY, IN_OTHER } state = OUTSIDE;
+    bool sawOsm = isFragment;
+
+    while (this->nextItem())
+    {
+      const char* item = this->Item;
+      const char* end = item + this->ItemLength;
+
+      //
+      // skip declarations, comments and processing instructions:
+      //
+      if (this->ItemLength == 0 || item[0] == '?' || item[0] == '!')
+      {
+        continue;
+      }
+
+      bool closing = (item[0] == '/');
+      if (closing)
+      {
+        item++;
+      }
+
+      bool selfClosing = (end > item && end[-1] == '/');
+      if (selfClosing)
+      {
+        end--;
+      }
+
+      const char* nameEnd = item;
+      while (nameEnd < end && !isspace((unsigned char) *nameEnd) && *nameEnd != '/') nameEnd++;
+      string_view name(item, nameEnd - item);
+
+      if (!sawOsm)
+      {
+        if (name != "osm" || closing)
+        {
+          return false;
+        }
+        sawOsm = true;
+        continue;
+      }
+
+      if (closing)
+      {
+        if (name == "node" && state == IN_NODE)
+        {
+          this->finishTags();
+          handler.node(this->Element);
+          state = OUTSIDE;
+        }
+        else if (name == "way" && state == IN_WAY)
+        {
+          this->finishTags();
+          handler.way(this->Element);
+          state = OUTSIDE;
+        }
+        else if (name == "relation" && state == IN_OTHER)
+        {
+          state = OUTSIDE;
+        }
+        continue;
+      }
+
+      if (name == "node")
+      {
+        this->parseAttributes(nameEnd, end);
+        this->Element.Type = OsmElement::NODE;
+        this->Element.ID = this->int64Attribute("id");
+        this->Element.Lat = this->doubleAttribute("lat");
+        this->Element.Lon = this->doubleAttribute("lon");
+        this->clearTags();
+        this->Element.NodeRefs.clear();
+
+        if (selfClosing)
+        {
+          this->finishTags();
+          handler.node(this->Element);
+        }
+        else
+        {
+          state = IN_NODE;
+        }
+      }
+      else if (name == "way")
+      {
+        this->parseAttributes(nameEnd, end);
+        this->Element.Type = OsmElement::WAY;
+        this->Element.ID = this->int64Attribute("id");
+        this->Element.Lat = 0.0;
+        this->Element.Lon = 0.0;
+        this->clearTags();
+        this->Element.NodeRefs.clear();
+
+        if (selfClosing)
+        {
+          this->finishTags();
+          handler.way(this->Element);
+        }
+        else
+        {
+          state = IN_WAY;
+        }
+      }
+      else if (name == "relation")
+      {
+        if (!selfClosing)
+        {
+          state = IN_OTHER;
+        }
+      }
+      else if (name == "nd" && state == IN_WAY)
+      {
+        this->parseAttributes(nameEnd, end);
+        this->Element.NodeRefs.push_back(this->int64Attribute("ref"));
+      }
+      else if (name == "tag" && (state == IN_NODE || state == IN_WAY))
+      {
+        this->parseAttributes(nameEnd, end);
+
+        const Attribute* k = this->findAttribute("k");
+        const Attribute* v = this->findAttribute("v");
+
+        if (k != nullptr && v != nullptr)
+        {
+          string& text = this->Element.TagText;
+
+          this->TagBounds.push_back(text.size());
+          decodeValue(k->Value, k->Value + k->ValueLength, text);
+          this->TagBounds.push_back(text.size() - this->TagBounds.back());
+
+          this->TagBounds.push_back(text.size());
+          decodeValue(v->Value, v->Value + v->ValueLength, text);
+          this->TagBounds.push_back(text.size() - this->TagBounds.back());
+        }
+      }
+    }
+
+    //
+    // the file must not end in the middle of an element:
+    //
+    if (state != OUTSIDE)
+    {
+      this->Truncated = true;
+    }
+
+    return sawOsm;
+  }
+};
+
+
+//
+// osmStreamMapFile
+//
+// Streams the given OSM XML file through the handler.
+//
+bool osmStreamMapFile(string filename, OsmHandler& handler)
+{
+  OsmStreamReader reader;
+
+  if (!reader.open(filename))
+  {
+    if (!reader.inputError())
+    {
+      cerr << "**ERROR: unable to open XML file '" << filename << "'." << endl;
+    }
+    return false;
+  }
+
+  bool sawOsm = reader.run(handler, false);
+
+  if (reader.inputError())
+  {
+    return false;
+  }
+
+  if (!sawOsm)
+  {
+    cerr << "**ERROR: unable to find top-level 'osm' XML element." << endl;
+    cerr << "**ERROR: this file is probably not an Open Street Map." << endl;
+    return false;
+  }
+
+  if (reader.Truncated || reader.Malformed)
+  {
+    cerr << "**ERROR: XML file '" << filename << "' is truncated or malformed." << endl;
+    return false;
+  }
+
+  return true;
+}
+
+
+
+//
+// osmStreamMapBuffer
+//
+// Streams OSM XML text held in memory through the handler.
+//
+bool osmStreamMapBuffer(const char* data, size_t size, OsmHandler& handler, bool isFragment)
+{
+  OsmStreamReader reader;
+
+  reader.openBuffer(data, size);
+
+  if (!reader.run(handler, isFragment))
+  {
+    cerr << "**ERROR: unable to find top-level 'osm' XML element." << endl;
+    cerr << "**ERROR: this file is probably not an Open Street Map." << endl;
+    return false;
+  }
+
+  if (reader.Truncated || reader.Malformed)
+  {
+    cerr << "**ERROR: XML text is truncated or malformed." << endl;
+    return false;
+  }
+
+  return true;
+}
+
+
+//
+// isElementStart
+//
+// True if data[pos] starts a <node>, <way> or <relation> tag.
+//
+static bool isElementStart(const char* data, size_t size, size_t pos)
+{
+  for (const char* name : { "<node", "<way", "<relation" })
+  {
+    size_t length = strlen(name);
+
+    if (pos + length < size && memcmp(data + pos, name, length) == 0)
+    {
+      char next = data[pos + length];
+      if (isspace((unsigned char) next) || next == '>' || next == '/')
+      {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+//
+// osmSplitMapBuffer
+//
+// Splits OSM XML text into numParts ranges of about equal size, each
+// starting at a <node>, <way> or <relation> tag, except the first.
+// These tags never occur inside another element (and a '<' inside an
+// attribute value is always escaped), so no element straddles two
+// ranges. Returns the start offsets of the ranges, first one 0.
+//
+vector<size_t> osmSplitMapBuffer(const char* data, size_t size, int numParts)
+{
+  vector<size_t> starts = { 0 };
+
+  for (int part = 1; part < numParts; part++)
+  {
+    size_t pos = max(starts.back() + 1, size / numParts * part);
+
+    while (pos < size)
+    {
+      const char* lt = (const char*) memchr(data + pos, '<', size - pos);
+      if (lt == nullptr)
+      {
+        pos = size;
+        break;
+      }
+
+      pos = lt - data;
+      if (isElementStart(data, size, pos))
+      {
+        break;
+      }
+      pos++;
+    }
+
+    if (pos >= size)
+    {
+      break;
+    }
+
+    starts.push_back(pos);
+  }
+
+  return starts;
+}
@@ -0,0 +1,110 @@
+/*osmstream.h*/
+
+//
+// Streaming reader for Open Street Map XML files.
+//
+// osmLoadMapFile() loads the whole file into a tinyxml2 document
+// before anything can be read out of it, so memory grows with the
+// size of the XML. The streaming reader instead reads the file a
+// chunk at a time and hands each <node> and <way> to a handler as
+// soon as its closing tag is seen; nothing is kept once the handler
+// returns. Memory then grows with the model being built, not with
+// the file.
+//
+// References:
+//
+// OpenStreetMap XML format:
+//   https://wiki.openstreetmap.org/wiki/OSM_XML
+//
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+
+using namespace std;
+
+
+//
+// OsmElement
+//
+// One <node> or <way> element, with its (key, value) tags and, for
+// ways, the ids of the nodes it references. The reader reuses a
+// single OsmElement for every element in the file, so a handler that
+// wants to keep any of it must copy it.
+//
+// Tags are views into TagText, which holds the decoded keys and values
+// back to back. Both are reused from element to element, so once they
+// have grown to fit the largest element, reading tags never allocates.
+//
+class OsmElement
+{
+public:
+  enum ElementType { NODE, WAY };
+
+  ElementType Type;
+  long long ID;
+  double Lat;  // nodes only
+  double Lon;  // nodes only
+  vector<pair<string_view, string_view>> Tags;
+  vector<long long> NodeRefs;  // ways only
+  string TagText;
+
+  //
+  // same as osmContainsKeyValue / osmGetKeyValue in osm.h, but
+  // for a streamed element (see tagmatch.h to look for several
+  // tags at once):
+  //
+  bool containsKeyValue(string_view key, string_view value) const;
+  string_view getKeyValue(string_view key) const;
+};
+
+
+//
+// OsmHandler
+//
+// Receives the elements of a streamed map, in file order. Override
+// the callbacks for the element types of interest.
+//
+class OsmHandler
+{
+public:
+  virtual ~OsmHandler() {}
+
+  virtual void node([[maybe_unused]] const OsmElement& node) {}
+  virtual void way([[maybe_unused]] const OsmElement& way) {}
+};
+
+
+//
+// osmStreamMapFile
+//
+// Streams the given OSM XML file through the handler. The file may be
+// gzip- or zstd-compressed; it is then decompressed as it is read (see
+// mapinput.h). Returns true if successful, false if the file could not
+// be opened or decompressed, is not an Open Street Map document, or is
+// malformed (elements already handed to the handler stay handed over).
+//
+bool osmStreamMapFile(string filename, OsmHandler& handler);
+
+//
+// osmStreamMapBuffer
+//
+// Same as osmStreamMapFile, for OSM XML text already in memory. If
+// isFragment is true, the text is one of the ranges returned by
+// osmSplitMapBuffer rather than a whole document, and need not contain
+// the top-level <osm> element.
+//
+bool osmStreamMapBuffer(const char* data, size_t size, OsmHandler& handler, bool isFragment);
+
+//
+// osmSplitMapBuffer
+//
+// Splits OSM XML text into (at most) numParts ranges of about equal
+// size, on element boundaries, so the ranges can be streamed in
+// parallel. Returns the offset at which each range starts; each range
+// ends where the next one starts.
+//
+vector<size_t> osmSplitMapBuffer(const char* data, size_t size, int numParts);
@@ -0,0 +1,114 @@
+/*parallel.h*/
+
+//
+// Small helpers for running work on several threads.
+//
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <functional>
+
+using namespace std;
+
+
+//
+// defaultThreadCount
+//
+// The number of threads to use when none is given: one per core.
+//
+inline int defaultThreadCount()
+{
+  unsigned int n = thread::hardware_concurrency();
+  return n == 0 ? 1 : (int) n;
+}
+
+//
+// parallelFor
+//
+// Calls work(i) for i = 0 .. n-1, each on its own thread, and waits
+// for all of them to finish. With n = 1, work runs on the calling
+// thread.
+//
+inline void parallelFor(int n, const function<void(int)>& work)
+{
+  if (n <= 1)
+  {
+    if (n == 1) work(0);
+    return;
+  }
+
+  vector<thread> threads;
+  for (int i = 0; i < n; i++)
+  {
+    threads.emplace_back(work, i);
+  }
+
+  for (thread& t : threads)
+  {
+    t.join();
+  }
+}
+
+//
+// parallelSort
+//
+// Sorts the vector with the given comparison using up to numThreads
+// threads: the vector is cut into runs that are sorted concurrently,
+// then neighbouring runs are merged pairwise, again concurrently,
+// until one run is left. The sort is stable: equal values keep their
+// relative order.
+//
+template <typename T, typename Compare>
+void parallelSort(vector<T>& values, Compare comp, int numThreads)
+{
+  size_t n = values.size();
+  size_t numRuns = (size_t) max(1, numThreads);
+
+  //
+  // not worth a thread per run for small inputs:
+  //
+  const size_t MIN_RUN = 1 << 14;
+  numRuns = min(numRuns, max((size_t) 1, n / MIN_RUN));
+
+  if (numRuns <= 1)
+  {
+    stable_sort(values.begin(), values.end(), comp);
+    return;
+  }
+
+  vector<size_t> bounds;
+  for (size_t r = 0; r <= numRuns; r++)
+  {
+    bounds.push_back(n * r / numRuns);
+  }
+
+  parallelFor((int) numRuns, [&](int r) {
+    stable_sort(values.begin() + bounds[r], values.begin() + bounds[r + 1], comp);
+  });
+
+  while (bounds.size() > 2)
+  {
+    vector<size_t> merged;
+    int numMerges = (int) (bounds.size() - 1) / 2;
+
+    parallelFor(numMerges, [&](int m) {
+      inplace_merge(values.begin() + bounds[2 * m],
+                    values.begin() + bounds[2 * m + 1],
+                    values.begin() + bounds[2 * m + 2], comp);
+    });
+
+    for (size_t b = 0; b < bounds.size(); b += 2)
+    {
+      merged.push_back(bounds[b]);
+    }
+    if (merged.back() != bounds.back())
+    {
+      merged.push_back(bounds.back());
+    }
+
+    bounds = merged;
+  }
+}
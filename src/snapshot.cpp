@@ -0,0 +1,553 @@
+/*snapshot.cpp*/
+
+//
+// Binary snapshot of a parsed map: nodes, buildings and bus stops.
+// See snapshot.h for the file layout.
+//
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+using namespace std;
+
+
+static const char SNAPSHOT_MAGIC[8] = { 'N', 'U', 'O', 'S', 'M', 'S', 'N', 'P' };
+
+//
+// fnv1a
+//
+// 64-bit FNV-1a hash of the given bytes.
+//
+static uint64_t fnv1a(const char* data, size_t size)
+{
+  uint64_t hash = 14695981039346656037ULL;
+
+  for (size_t i = 0; i < size; i++)
+  {
+    hash ^= (unsigned char) data[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+//
+// rounds n up to the next multiple of 8, so every section is aligned
+// for the int64 / double arrays it holds:
+//
+static uint64_t align8(uint64_t n)
+{
+  return (n + 7) & ~(uint64_t) 7;
+}
+
+//
+// the number of 64-bit words in the entrance bitset of n nodes:
+//
+static uint64_t entranceWords(uint64_t n)
+{
+  return n / 64 + (n % 64 != 0 ? 1 : 0);
+}
+
+
+//
+// constructor / destructor
+//
+Snapshot::Snapshot()
+  : Data(nullptr), Size(0), Header(nullptr)
+{
+}
+
+Snapshot::~Snapshot()
+{
+  this->close();
+}
+
+void Snapshot::close()
+{
+  this->Mapping.reset();  // unmapped once loaded collections let go too
+  this->Data = nullptr;
+  this->Size = 0;
+  this->Header = nullptr;
+}
+
+
+//
+// open
+//
+// Maps the given file and checks magic, version, section bounds
+// and checksum.
+//
+bool Snapshot::open(string filename)
+{
+  this->close();
+
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    cerr << "**ERROR: unable to open snapshot file '" << filename << "'." << endl;
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(SnapshotHeader))
+  {
+    cerr << "**ERROR: snapshot file '" << filename << "' is too small." << endl;
+    ::close(fd);
+    return false;
+  }
+
+  size_t size = (size_t) info.st_size;
+  void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);  // the mapping keeps the file alive
+
+  if (data == MAP_FAILED)
+  {
+    cerr << "**ERROR: unable to map snapshot file '" << filename << "'." << endl;
+    return false;
+  }
+
+  this->Mapping = shared_ptr<const char>((const char*) data, [size](const char* p) {
+    munmap((void*) p, size);
+  });
+  this->Data = this->Mapping.get();
+  this->Size = size;
+  this->Header = (const SnapshotHeader*) data;
+
+  const SnapshotHeader& h = *this->Header;
+
+  if (memcmp(h.Magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0)
+  {
+    cerr << "**ERROR: '" << filename << "' is not a snapshot file." << endl;
+    this->close();
+    return false;
+  }
+
+  if (h.Version != SNAPSHOT_VERSION || h.HeaderSize != sizeof(SnapshotHeader))
+  {
+    cerr << "**ERROR: snapshot '" << filename << "' has version " << h.Version
+         << ", expected " << SNAPSHOT_VERSION << "; rebuild it." << endl;
+    this->close();
+    return false;
+  }
+
+  //
+  // every section must lie inside the file; the count is compared
+  // with the room left rather than multiplied out, so a huge count
+  // cannot wrap around and pass:
+  //
+  struct { uint64_t offset; uint64_t count; uint64_t elementSize; } sections[] = {
+    { h.NodeIDsOffset,       h.NumNodes,       sizeof(int64_t) },
+    { h.NodeLatsOffset,      h.NumNodes,       sizeof(int32_t) },
+    { h.NodeLonsOffset,      h.NumNodes,       sizeof(int32_t) },
+    { h.NodeEntrancesOffset, entranceWords(h.NumNodes), sizeof(uint64_t) },
+    { h.BuildingsOffset,     h.NumBuildings,   sizeof(SnapshotBuilding) },
+    { h.NodeRefsOffset,      h.NumNodeRefs,    sizeof(int64_t) },
+    { h.StopsOffset,         h.NumStops,       sizeof(SnapshotStop) },
+    { h.StringsOffset,       h.NumStringBytes, sizeof(char) },
+  };
+
+  //
+  // buildings hold 32-bit offsets into the node IDs and strings:
+  //
+  bool valid = (h.FileSize == size && h.NumNodeRefs <= UINT32_MAX && h.NumStringBytes <= UINT32_MAX);
+  for (auto& section : sections)
+  {
+    if (section.offset % 8 != 0 || section.offset > size
+        || section.count > (size - section.offset) / section.elementSize)
+    {
+      valid = false;
+    }
+  }
+
+  if (!valid)
+  {
+    cerr << "**ERROR: snapshot '" << filename << "' is truncated or malformed." << endl;
+    this->close();
+    return false;
+  }
+
+  if (fnv1a(this->Data + h.HeaderSize, size - h.HeaderSize) != h.Checksum)
+  {
+    cerr << "**ERROR: snapshot '" << filename << "' failed its checksum." << endl;
+    this->close();
+    return false;
+  }
+
+  //
+  // references into other sections must be in bounds too:
+  //
+  const SnapshotBuilding* buildings = this->getBuildings();
+  for (uint64_t i = 0; i < h.NumBuildings && valid; i++)
+  {
+    const SnapshotBuilding& b = buildings[i];
+    valid = b.FirstNodeRef <= h.NumNodeRefs && b.NumNodeRefs <= h.NumNodeRefs - b.FirstNodeRef
+      && (uint64_t) b.Name.Offset + b.Name.Length <= h.NumStringBytes
+      && (uint64_t) b.StreetAddress.Offset + b.StreetAddress.Length <= h.NumStringBytes;
+  }
+
+  const SnapshotStop* stops = this->getStops();
+  for (uint64_t i = 0; i < h.NumStops && valid; i++)
+  {
+    for (const SnapshotString* s : { &stops[i].ID, &stops[i].Route, &stops[i].Name,
+                                     &stops[i].Direction, &stops[i].Location })
+    {
+      valid = valid && (uint64_t) s->Offset + s->Length <= h.NumStringBytes;
+    }
+  }
+
+  //
+  // Nodes::find needs the node ids sorted and unique, as they were
+  // when the snapshot was written:
+  //
+  const int64_t* ids = this->getNodeIDs();
+  for (uint64_t i = 1; i < h.NumNodes && valid; i++)
+  {
+    valid = ids[i - 1] < ids[i];
+  }
+
+  if (!valid)
+  {
+    cerr << "**ERROR: snapshot '" << filename << "' is malformed." << endl;
+    this->close();
+    return false;
+  }
+
+  return true;
+}
+
+
+//
+// load
+//
+// The node columns and the buildings' node IDs and strings are
+// borrowed from the mapping (see column.h), each column holding on to
+// it; only the building records and the stops are built, each sized
+// once up front. Collections already holding data get the borrowed
+// ones appended, which copies them.
+//
+void Snapshot::load(Nodes& nodes, Buildings& buildings, BusStops& busStops) const
+{
+  const SnapshotHeader& h = *this->Header;
+
+  static_assert(sizeof(long long) == sizeof(int64_t), "node ids are stored as int64");
+
+  Nodes mappedNodes;
+  mappedNodes.IDs.borrow((const long long*) this->getNodeIDs(), h.NumNodes, this->Mapping);
+  mappedNodes.Lats.borrow(this->getNodeLats(), h.NumNodes, this->Mapping);
+  mappedNodes.Lons.borrow(this->getNodeLons(), h.NumNodes, this->Mapping);
+  mappedNodes.EntranceBits.borrow(this->getNodeEntrances(), entranceWords(h.NumNodes), this->Mapping);
+  NodeStats::countAdded((long long) h.NumNodes);
+
+  if (nodes.getNumMapNodes() == 0)
+  {
+    mappedNodes.IndexKind = nodes.IndexKind;
+    nodes = std::move(mappedNodes);
+  }
+  else
+  {
+    nodes.append(mappedNodes);
+  }
+
+  nodes.buildIndex();
+
+  const SnapshotBuilding* records = this->getBuildings();
+  Buildings mappedBuildings;
+
+  mappedBuildings.NodeRefs.borrow((const long long*) this->getNodeRefs(), h.NumNodeRefs, this->Mapping);
+  mappedBuildings.Strings.borrow(this->Data + h.StringsOffset, h.NumStringBytes, this->Mapping);
+  mappedBuildings.reserve(h.NumBuildings);
+
+  for (uint64_t i = 0; i < h.NumBuildings; i++)
+  {
+    const SnapshotBuilding& r = records[i];
+
+    mappedBuildings.addStored(r.ID, r.Name.Offset, r.Name.Length,
+                              r.StreetAddress.Offset, r.StreetAddress.Length,
+                              (uint32_t) r.FirstNodeRef, (uint32_t) r.NumNodeRefs);
+  }
+
+  if (buildings.getNumMapBuildings() == 0)
+  {
+    buildings = std::move(mappedBuildings);
+  }
+  else
+  {
+    buildings.append(mappedBuildings);
+  }
+
+  const SnapshotStop* stops = this->getStops();
+
+  busStops.reserve(busStops.getMapStops().size() + h.NumStops);
+  for (uint64_t i = 0; i < h.NumStops; i++)
+  {
+    const SnapshotStop& s = stops[i];
+
+    busStops.add(BusStop(string(this->getString(s.ID)), string(this->getString(s.Route)),
+      string(this->getString(s.Name)), string(this->getString(s.Direction)),
+      string(this->getString(s.Location)), fromFixedCoord(s.Lat), fromFixedCoord(s.Lon)));
+  }
+
+  busStops.buildIndex();
+}
+
+
+//
+// write
+//
+// Lays the collections out in one buffer, following the layout in
+// snapshot.h, then writes it to a temporary file and renames that
+// over the destination.
+//
+bool Snapshot::write(string filename, const Nodes& nodes,
+                     const Buildings& buildings, const BusStops& busStops)
+{
+  //
+  // packed node ids are written from an unpacked copy:
+  //
+  vector<long long> unpackedIDs;
+  bool packed = (nodes.ActiveIndex == NodeIndexKind::PACKED);
+
+  if (packed)
+  {
+    nodes.Packed.unpack(unpackedIDs);
+  }
+
+  ArrayView<long long> nodeIDs = packed ? ArrayView<long long>(unpackedIDs) : nodes.IDs.view();
+
+  //
+  // open requires sorted, unique node ids, which nodes loaded with a
+  // hash index need not have:
+  //
+  for (size_t i = 1; i < nodeIDs.size(); i++)
+  {
+    if (nodeIDs[i - 1] >= nodeIDs[i])
+    {
+      cerr << "**ERROR: nodes must be sorted by ID to write snapshot '" << filename << "'." << endl;
+      return false;
+    }
+  }
+
+  string strings;
+
+  auto addString = [&](string_view s) {
+    SnapshotString result;
+    result.Offset = (uint32_t) strings.size();
+    result.Length = (uint32_t) s.size();
+    strings += s;
+    return result;
+  };
+
+  //
+  // flatten the buildings and stops first, which also fills the
+  // string section:
+  //
+  vector<SnapshotBuilding> records;
+  vector<int64_t> refs;
+
+  for (const Building& B : buildings.getMapBuildings())
+  {
+    SnapshotBuilding r;
+    memset(&r, 0, sizeof(r));
+
+    ArrayView<long long> nodeIDs = B.getNodeIDs();
+
+    r.ID = B.getID();
+    r.Name = addString(B.getName());
+    r.StreetAddress = addString(B.getStreetAddress());
+    r.FirstNodeRef = refs.size();
+    r.NumNodeRefs = nodeIDs.size();
+
+    refs.insert(refs.end(), nodeIDs.begin(), nodeIDs.end());
+    records.push_back(r);
+  }
+
+  vector<SnapshotStop> stops;
+
+  for (const BusStop& S : busStops.getMapStops())
+  {
+    SnapshotStop s;
+    memset(&s, 0, sizeof(s));
+
+    s.ID = addString(S.getID());
+    s.Route = addString(S.getStreet());
+    s.Name = addString(S.getName());
+    s.Direction = addString(S.getDirection());
+    s.Location = addString(S.getLocation());
+    s.Lat = toFixedCoord(S.getLat());
+    s.Lon = toFixedCoord(S.getLon());
+
+    stops.push_back(s);
+  }
+
+  //
+  // now compute the section offsets:
+  //
+  SnapshotHeader h;
+  memset(&h, 0, sizeof(h));
+
+  memcpy(h.Magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+  h.Version = SNAPSHOT_VERSION;
+  h.HeaderSize = sizeof(SnapshotHeader);
+
+  h.NumNodes = nodeIDs.size();
+  h.NumBuildings = records.size();
+  h.NumNodeRefs = refs.size();
+  h.NumStops = stops.size();
+  h.NumStringBytes = strings.size();
+
+  uint64_t offset = align8(sizeof(SnapshotHeader));
+
+  h.NodeIDsOffset = offset;        offset = align8(offset + h.NumNodes * sizeof(int64_t));
+  h.NodeLatsOffset = offset;       offset = align8(offset + h.NumNodes * sizeof(int32_t));
+  h.NodeLonsOffset = offset;       offset = align8(offset + h.NumNodes * sizeof(int32_t));
+  h.NodeEntrancesOffset = offset;  offset = align8(offset + entranceWords(h.NumNodes) * sizeof(uint64_t));
+  h.BuildingsOffset = offset;      offset = align8(offset + h.NumBuildings * sizeof(SnapshotBuilding));
+  h.NodeRefsOffset = offset;       offset = align8(offset + h.NumNodeRefs * sizeof(int64_t));
+  h.StopsOffset = offset;          offset = align8(offset + h.NumStops * sizeof(SnapshotStop));
+  h.StringsOffset = offset;        offset = offset + h.NumStringBytes;
+
+  h.FileSize = offset;
+
+  //
+  // fill the buffer (zeroed, so padding bytes are deterministic):
+  //
+  vector<char> buffer(h.FileSize, 0);
+  char* base = buffer.data();
+
+  int64_t* ids = (int64_t*) (base + h.NodeIDsOffset);
+  int32_t* lats = (int32_t*) (base + h.NodeLatsOffset);
+  int32_t* lons = (int32_t*) (base + h.NodeLonsOffset);
+  uint64_t* entrances = (uint64_t*) (base + h.NodeEntrancesOffset);
+
+  static_assert(sizeof(long long) == sizeof(int64_t), "node ids are stored as int64");
+
+  memcpy(ids, nodeIDs.begin(), h.NumNodes * sizeof(int64_t));
+  memcpy(lats, nodes.Lats.data(), h.NumNodes * sizeof(int32_t));
+  memcpy(lons, nodes.Lons.data(), h.NumNodes * sizeof(int32_t));
+
+  for (size_t i = 0; i < h.NumNodes; i++)
+  {
+    if (nodes.isEntrance(i))
+    {
+      entrances[i / 64] |= (uint64_t) 1 << (i % 64);
+    }
+  }
+
+  memcpy(base + h.BuildingsOffset, records.data(), records.size() * sizeof(SnapshotBuilding));
+  memcpy(base + h.NodeRefsOffset, refs.data(), refs.size() * sizeof(int64_t));
+  memcpy(base + h.StopsOffset, stops.data(), stops.size() * sizeof(SnapshotStop));
+  memcpy(base + h.StringsOffset, strings.data(), strings.size());
+
+  h.Checksum = fnv1a(base + h.HeaderSize, h.FileSize - h.HeaderSize);
+  memcpy(base, &h, sizeof(h));
+
+  //
+  // write to a temp file, then rename over the destination:
+  //
+  string tempname = filename + ".tmp";
+
+  ofstream outfile(tempname, ios::binary | ios::trunc);
+  if (!outfile.good())
+  {
+    cerr << "**ERROR: unable to create snapshot file '" << tempname << "'." << endl;
+    return false;
+  }
+
+  outfile.write(base, buffer.size());
+  outfile.close();
+
+  if (outfile.fail())
+  {
+    cerr << "**ERROR: unable to write snapshot file '" << tempname << "'." << endl;
+    remove(tempname.c_str());
+    return false;
+  }
+
+  if (rename(tempname.c_str(), filename.c_str()) != 0)
+  {
+    cerr << "**ERROR: unable to rename '" << tempname << "' to '" << filename << "'." << endl;
+    remove(tempname.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+
+//
+// isSnapshotFile
+//
+// Returns true if the file starts with the snapshot magic bytes.
+//
+bool Snapshot::isSnapshotFile(string filename)
+{
+  ifstream infile(filename, ios::binary);
+  char magic[sizeof(SNAPSHOT_MAGIC)];
+
+  if (!infile.read(magic, sizeof(magic)))
+  {
+    return false;
+  }
+
+  return memcmp(magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0;
+}
+
+
+//
+// section accessors
+//
+const SnapshotHeader& Snapshot::getHeader() const
+{
+  return *this->Header;
+}
+
+const int64_t* Snapshot::getNodeIDs() const
+{
+  return (const int64_t*) (this->Data + this->Header->NodeIDsOffset);
+}
+
+const int32_t* Snapshot::getNodeLats() const
+{
+  return (const int32_t*) (this->Data + this->Header->NodeLatsOffset);
+}
+
+const int32_t* Snapshot::getNodeLons() const
+{
+  return (const int32_t*) (this->Data + this->Header->NodeLonsOffset);
+}
+
+const uint64_t* Snapshot::getNodeEntrances() const
+{
+  return (const uint64_t*) (this->Data + this->Header->NodeEntrancesOffset);
+}
+
+const SnapshotBuilding* Snapshot::getBuildings() const
+{
+  return (const SnapshotBuilding*) (this->Data + this->Header->BuildingsOffset);
+}
+
+const int64_t* Snapshot::getNodeRefs() const
+{
+  return (const int64_t*) (this->Data + this->Header->NodeRefsOffset);
+}
+
+const SnapshotStop* Snapshot::getStops() const
+{
+  return (const SnapshotStop*) (this->Data + this->Header->StopsOffset);
+}
+
+string_view Snapshot::getString(const SnapshotString& s) const
+{
+  return string_view(this->Data + this->Header->StringsOffset + s.Offset, s.Length);
+}
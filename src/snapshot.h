@@ -0,0 +1,186 @@
+/*snapshot.h*/
+
+//
+// Binary snapshot of a parsed map: nodes, buildings and bus stops.
+//
+// Parsing the OSM XML is by far the slowest part of startup, so the
+// parsed model can be written once to a flat, checksummed binary file
+// and read back later without any XML or text parsing. The file is
+// mapped read-only and shared, and the node columns, the buildings'
+// node IDs and the name / address strings are served straight from
+// the mapping (see column.h): they are never copied, and every process
+// that loads the same snapshot shares their pages through the page
+// cache. What is still built per process is small next to them: one
+// fixed-size record per building, the bus stops (which own their
+// strings), the search indexes other than the sorted id column, and
+// the buildings' resolved node indices (see Buildings::resolveNodes).
+//
+// File layout (all integers little-endian, sections 8-byte aligned):
+//
+//   SnapshotHeader
+//   node ids           int64[NumNodes]     (same order as Nodes)
+//   node latitudes     int32[NumNodes]     (fixed-point, see coord.h)
+//   node longitudes    int32[NumNodes]
+//   node entrances     uint64[(NumNodes + 63) / 64]
+//                                          (bit i % 64 of word i / 64
+//                                          set = node i is an entrance)
+//   buildings          SnapshotBuilding[NumBuildings]
+//   building node refs int64[NumNodeRefs]  (perimeters, back to back)
+//   bus stops          SnapshotStop[NumStops]
+//   strings            char[NumStringBytes] (names, addresses, ...)
+//
+// The checksum is FNV-1a over every byte after the header, so a
+// truncated or corrupted file is rejected rather than served.
+//
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+#include "nodes.h"
+#include "buildings.h"
+#include "busstops.h"
+
+using namespace std;
+
+
+//
+// Bump whenever the layout below changes; older files are rejected.
+//
+const uint32_t SNAPSHOT_VERSION = 3;
+
+struct SnapshotString
+{
+  uint32_t Offset;  // into the string section
+  uint32_t Length;
+};
+
+struct SnapshotHeader
+{
+  char     Magic[8];  // "NUOSMSNP"
+  uint32_t Version;
+  uint32_t HeaderSize;
+  uint64_t FileSize;
+  uint64_t Checksum;
+
+  uint64_t NumNodes;
+  uint64_t NumBuildings;
+  uint64_t NumNodeRefs;
+  uint64_t NumStops;
+  uint64_t NumStringBytes;
+
+  uint64_t NodeIDsOffset;
+  uint64_t NodeLatsOffset;
+  uint64_t NodeLonsOffset;
+  uint64_t NodeEntrancesOffset;
+  uint64_t BuildingsOffset;
+  uint64_t NodeRefsOffset;
+  uint64_t StopsOffset;
+  uint64_t StringsOffset;
+};
+
+struct SnapshotBuilding
+{
+  int64_t        ID;
+  SnapshotString Name;
+  SnapshotString StreetAddress;
+  uint64_t       FirstNodeRef;  // index into the node refs section
+  uint64_t       NumNodeRefs;
+};
+
+struct SnapshotStop
+{
+  SnapshotString ID;
+  SnapshotString Route;
+  SnapshotString Name;
+  SnapshotString Direction;
+  SnapshotString Location;
+  int32_t        Lat;  // fixed-point, see coord.h
+  int32_t        Lon;
+};
+
+
+//
+// Snapshot
+//
+// A read-only, memory-mapped snapshot file. open() maps and validates
+// the file; the section accessors then point straight into the mapping
+// and stay valid until the snapshot is closed or destroyed. The
+// collections filled by load share the mapping, which stays until the
+// last of them lets go of it, so the snapshot itself can be closed
+// once they are loaded.
+//
+class Snapshot
+{
+private:
+  shared_ptr<const char> Mapping;  // unmaps when the last user lets go
+  const char*           Data;
+  size_t                Size;
+  const SnapshotHeader* Header;
+
+  //
+  // not copyable, since we own the mapping:
+  //
+  Snapshot(const Snapshot&) = delete;
+  Snapshot& operator=(const Snapshot&) = delete;
+
+public:
+  Snapshot();
+  ~Snapshot();
+
+  //
+  // open
+  //
+  // Maps the given file and checks magic, version, section bounds
+  // and checksum. Returns false (with a message on cerr) if the file
+  // cannot be used.
+  //
+  bool open(string filename);
+  void close();
+
+  //
+  // load
+  //
+  // Fills the given collections from the open snapshot. Into empty
+  // ones the node columns, node IDs and strings are borrowed from the
+  // mapping rather than copied (non-empty ones get a copy appended).
+  // The buildings are left unresolved: call Buildings::resolveNodes
+  // afterwards.
+  //
+  void load(Nodes& nodes, Buildings& buildings, BusStops& busStops) const;
+
+  //
+  // write
+  //
+  // Writes the given collections to a new snapshot file. The file is
+  // written under a temporary name and then renamed, so processes that
+  // have the old snapshot mapped are not disturbed. Returns false if
+  // the file could not be written.
+  //
+  static bool write(string filename, const Nodes& nodes,
+                    const Buildings& buildings, const BusStops& busStops);
+
+  //
+  // isSnapshotFile
+  //
+  // Returns true if the file starts with the snapshot magic bytes.
+  //
+  static bool isSnapshotFile(string filename);
+
+  //
+  // section accessors
+  //
+  const SnapshotHeader& getHeader() const;
+  const int64_t* getNodeIDs() const;
+  const int32_t* getNodeLats() const;
+  const int32_t* getNodeLons() const;
+  const uint64_t* getNodeEntrances() const;
+  const SnapshotBuilding* getBuildings() const;
+  const int64_t* getNodeRefs() const;
+  const SnapshotStop* getStops() const;
+  string_view getString(const SnapshotString& s) const;
+};
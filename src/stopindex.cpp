@@ -0,0 +1,336 @@
+/*stopindex.cpp*/
+
+//
+// Spatial index over bus stops.
+//
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+#include "stopindex.h"
+#include "dist.h"
+
+using namespace std;
+
+
+//
+// toUnitSphere
+//
+static void toUnitSphere(double lat, double lon, double& x, double& y, double& z)
+{
+  double phi = lat * M_PI / 180.0;
+  double lambda = lon * M_PI / 180.0;
+
+  x = cos(phi) * cos(lambda);
+  y = cos(phi) * sin(lambda);
+  z = sin(phi);
+}
+
+//
+// withSlack
+//
+// A squared chord plus a little slack for rounding (and for dist.cpp's
+// approximation of pi): a stop whose chord is beyond it is farther by
+// distBetween2Points too, so searching within it never misses a stop
+// that distBetween2Points puts as close.
+//
+static double withSlack(double chordSquared)
+{
+  if (chordSquared == numeric_limits<double>::max())
+  {
+    return chordSquared;
+  }
+
+  return chordSquared * (1.0 + 1e-9) + 1e-18;
+}
+
+
+//
+// Search
+//
+// The query and the best stops found so far, by squared chord. The
+// best are kept as a max-heap so the worst of them is at the front;
+// the stops that were within the bound when found but pushed out of
+// (or not let into) the best are kept too, as once measured they may
+// tie with the k-th best.
+//
+struct StopIndex::Search
+{
+  double X, Y, Z;
+  size_t K;
+  const function<bool(size_t)>* Accept;
+
+  vector<StopMatch> Best;    // by entry and squared chord, not stop and miles
+  vector<StopMatch> Passed;  // likewise
+  double BoundChordSquared;  // farther than this can't be among the best
+
+  double coordinate(int axis) const
+  {
+    return axis == 0 ? this->X : (axis == 1 ? this->Y : this->Z);
+  }
+
+  void offer(size_t entry, double chordSquared)
+  {
+    StopMatch match{ entry, chordSquared };
+
+    if (this->Best.size() == this->K)
+    {
+      if (!(match < this->Best.front()))
+      {
+        this->Passed.push_back(match);
+        return;
+      }
+
+      pop_heap(this->Best.begin(), this->Best.end());
+      this->Passed.push_back(this->Best.back());
+      this->Best.pop_back();
+    }
+
+    this->Best.push_back(match);
+    push_heap(this->Best.begin(), this->Best.end());
+
+    if (this->Best.size() == this->K)
+    {
+      this->BoundChordSquared = withSlack(this->Best.front().Distance);
+    }
+  }
+};
+
+
+//
+// BuildPoint
+//
+// A stop while the tree is built.
+//
+struct BuildPoint
+{
+  double C[3];
+  uint32_t Stop;
+};
+
+//
+// splitRange
+//
+// Splits points[lo, hi) around the median of its widest coordinate,
+// the median starting the right half, then splits each half, down to
+// ranges of leafSize or fewer. Each split is recorded at the position
+// of the median (which splitting the right half may then move).
+//
+static void splitRange(vector<BuildPoint>& points, size_t lo, size_t hi, size_t leafSize,
+                       vector<double>& splits, vector<uint8_t>& axes)
+{
+  if (hi - lo <= leafSize)
+  {
+    return;
+  }
+
+  double low[3] = { 2, 2, 2 }, high[3] = { -2, -2, -2 };
+
+  for (size_t i = lo; i < hi; i++)
+  {
+    for (int a = 0; a < 3; a++)
+    {
+      low[a] = min(low[a], points[i].C[a]);
+      high[a] = max(high[a], points[i].C[a]);
+    }
+  }
+
+  uint8_t axis = 0;
+  for (uint8_t a = 1; a < 3; a++)
+  {
+    if (high[a] - low[a] > high[axis] - low[axis])
+      axis = a;
+  }
+
+  size_t mid = lo + (hi - lo) / 2;
+
+  nth_element(points.begin() + lo, points.begin() + mid, points.begin() + hi,
+    [axis](const BuildPoint& p1, const BuildPoint& p2) { return p1.C[axis] < p2.C[axis]; });
+
+  splits[mid] = points[mid].C[axis];
+  axes[mid] = axis;
+
+  splitRange(points, lo, mid, leafSize, splits, axes);
+  splitRange(points, mid, hi, leafSize, splits, axes);
+}
+
+//
+// build
+//
+// Builds the tree over BuildPoints, then lays it out in Entries and
+// the coordinate arrays.
+//
+void StopIndex::build(const vector<BusStop>& stops, const vector<uint32_t>& positions)
+{
+  vector<BuildPoint> points;
+  points.reserve(positions.size());
+
+  for (uint32_t p : positions)
+  {
+    BuildPoint point;
+    toUnitSphere(stops[p].getLat(), stops[p].getLon(), point.C[0], point.C[1], point.C[2]);
+    point.Stop = p;
+
+    points.push_back(point);
+  }
+
+  vector<double> splits(points.size(), 0.0);
+  vector<uint8_t> axes(points.size(), 0);
+
+  splitRange(points, 0, points.size(), LeafSize, splits, axes);
+
+  this->Entries.clear();
+  this->X.clear();
+  this->Y.clear();
+  this->Z.clear();
+  this->Entries.reserve(points.size());
+  this->X.reserve(points.size());
+  this->Y.reserve(points.size());
+  this->Z.reserve(points.size());
+
+  for (size_t i = 0; i < points.size(); i++)
+  {
+    const BuildPoint& point = points[i];
+
+    this->Entries.push_back(Entry{ stops[point.Stop].getLat(), stops[point.Stop].getLon(),
+                                   splits[i], axes[i], point.Stop });
+    this->X.push_back(point.C[0]);
+    this->Y.push_back(point.C[1]);
+    this->Z.push_back(point.C[2]);
+  }
+}
+
+//
+// nearest
+//
+void StopIndex::nearest(double lat, double lon, size_t k, double radius,
+                        const function<bool(size_t)>& accept, vector<StopMatch>& matches) const
+{
+  matches.clear();
+
+  if (k == 0 || this->Entries.empty())
+  {
+    return;
+  }
+
+  Search search;
+  toUnitSphere(lat, lon, search.X, search.Y, search.Z);
+  search.K = k;
+  search.Accept = accept ? &accept : nullptr;
+  search.BoundChordSquared = radius == numeric_limits<double>::max()
+    ? radius : withSlack(milesToChordSquared(radius));
+
+  this->nearest(0, this->Entries.size(), search);
+
+  //
+  // measure the best, and the stops close enough to the k-th best to
+  // tie with it, with distBetween2Points:
+  //
+  DistanceFrom from(lat, lon);
+
+  auto measure = [&](const StopMatch& match) {
+    const Entry& e = this->Entries[match.Position];
+    double d = from.exact(e.Lat, e.Lon);
+
+    if (d <= radius)
+    {
+      matches.push_back(StopMatch{ e.Stop, d });
+    }
+  };
+
+  for (const StopMatch& match : search.Best)
+  {
+    measure(match);
+  }
+  for (const StopMatch& match : search.Passed)
+  {
+    if (match.Distance <= search.BoundChordSquared)
+      measure(match);
+  }
+
+  sort(matches.begin(), matches.end());
+  if (matches.size() > k)
+  {
+    matches.resize(k);
+  }
+}
+
+bool StopIndex::nearest(double lat, double lon, size_t& position, double& distance) const
+{
+  vector<StopMatch> matches;
+  this->nearest(lat, lon, 1, numeric_limits<double>::max(), nullptr, matches);
+
+  if (matches.empty())
+  {
+    return false;
+  }
+
+  position = matches[0].Position;
+  distance = matches[0].Distance;
+  return true;
+}
+
+//
+// nearest (subtree)
+//
+// Searches the half the query is in, then the other half if the split
+// is closer than the bound.
+//
+void StopIndex::nearest(size_t lo, size_t hi, Search& search) const
+{
+  if (hi - lo <= LeafSize)
+  {
+    this->nearestInLeaf(lo, hi, search);
+    return;
+  }
+
+  size_t mid = lo + (hi - lo) / 2;
+  const Entry& e = this->Entries[mid];
+  double diff = search.coordinate(e.Axis) - e.Split;
+
+  if (diff < 0)
+  {
+    this->nearest(lo, mid, search);
+    if (diff * diff <= search.BoundChordSquared)
+      this->nearest(mid, hi, search);
+  }
+  else
+  {
+    this->nearest(mid, hi, search);
+    if (diff * diff <= search.BoundChordSquared)
+      this->nearest(lo, mid, search);
+  }
+}
+
+//
+// nearestInLeaf
+//
+// Measures the chord to all of the leaf's stops at once, and offers
+// those within the bound.
+//
+void StopIndex::nearestInLeaf(size_t lo, size_t hi, Search& search) const
+{
+  double chords[LeafSize];
+  chordsSquared(search.X, search.Y, search.Z,
+                this->X.data() + lo, this->Y.data() + lo, this->Z.data() + lo, hi - lo, chords);
+
+  for (size_t i = lo; i < hi; i++)
+  {
+    if (chords[i - lo] > search.BoundChordSquared)
+    {
+      continue;
+    }
+
+    if (search.Accept == nullptr || (*search.Accept)(this->Entries[i].Stop))
+    {
+      search.offer(i, chords[i - lo]);
+    }
+  }
+}
+
+size_t StopIndex::size() const
+{
+  return this->Entries.size();
+}
@@ -0,0 +1,110 @@
+/*stopindex.h*/
+
+//
+// Spatial index over bus stops (see busstops.h).
+//
+// BusStops::closestStops used to compute the distance to every stop
+// for every query. StopIndex is a k-d tree instead, so a query visits
+// a few dozen stops however many there are.
+//
+// Each stop is placed at its position on the unit sphere, (x, y, z),
+// rather than at its (lat, lon): there the straight-line (chord)
+// distance between two stops grows with the great-circle distance,
+// and the tree has no seams at the poles or the date line. The tree
+// is stored in one array, each subtree's entries split around the
+// median of the coordinate that varies most, the lower half on the
+// left of the subtree's range; subtrees of up to LeafSize stops are
+// leaves. The coordinates are kept in separate x, y and z arrays, so
+// a leaf's stops are measured against the query all at once by
+// chordsSquared (see dist.h).
+//
+// A nearest-stops search descends toward the query point first, then
+// visits the far side of a split only if the split plane is closer
+// than the k-th best stop found so far (or than the radius, until k
+// are found). Stops are ranked by chord as they are found, which
+// takes no trigonometry (see chordSquaredToMiles in dist.h), and only
+// the k best, and any stop within rounding of the k-th, are measured
+// with distBetween2Points at the end. The result is ordered by that
+// distance, ties going to the stop added first, so it is exactly what
+// a scan over all stops would give.
+//
+
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+#include "busstop.h"
+
+using namespace std;
+
+
+//
+// StopMatch
+//
+// A stop found by a search: its position in the stops the index was
+// built over, and its distance in miles (see dist.h).
+//
+struct StopMatch
+{
+  size_t Position;
+  double Distance;
+
+  bool operator<(const StopMatch& other) const
+  {
+    return this->Distance < other.Distance
+      || (this->Distance == other.Distance && this->Position < other.Position);
+  }
+};
+
+
+class StopIndex
+{
+private:
+  static constexpr size_t LeafSize = 16;
+
+  struct Entry
+  {
+    double Lat, Lon;
+    double Split;      // if a range's right half starts here: the
+    uint8_t Axis;      // coordinate (0, 1 or 2) it splits on, and where
+    uint32_t Stop;     // position in the stops the index was built over
+  };
+
+  vector<Entry> Entries;
+  vector<double> X, Y, Z;  // on the unit sphere, parallel to Entries
+
+  struct Search;
+
+  void nearest(size_t lo, size_t hi, Search& search) const;
+  void nearestInLeaf(size_t lo, size_t hi, Search& search) const;
+
+public:
+  //
+  // build
+  //
+  // Builds the index over the stops at the given positions of stops.
+  //
+  void build(const vector<BusStop>& stops, const vector<uint32_t>& positions);
+
+  //
+  // nearest
+  //
+  // Finds the up to k indexed stops closest to (lat, lon) that are
+  // within radius miles and that accept (if given) accepts, by
+  // position. The matches are returned nearest first.
+  //
+  void nearest(double lat, double lon, size_t k, double radius,
+               const function<bool(size_t)>& accept, vector<StopMatch>& matches) const;
+
+  //
+  // Finds the indexed stop closest to (lat, lon). Returns false if the
+  // index is empty; otherwise the stop's position and its distance in
+  // miles are returned via the reference parameters.
+  //
+  bool nearest(double lat, double lon, size_t& position, double& distance) const;
+
+  size_t size() const;
+};
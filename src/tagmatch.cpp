@@ -0,0 +1,159 @@
+/*tagmatch.cpp*/
+
+//
+// Precompiled matching of Open Street Map tags.
+//
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+
+#include "tagmatch.h"
+
+using namespace std;
+
+
+//
+// TagMatch
+//
+void TagMatch::reset()
+{
+  fill(this->Values.begin(), this->Values.end(), string_view());
+  fill(this->Found.begin(), this->Found.end(), 0);
+  fill(this->Flags.begin(), this->Flags.end(), 0);
+}
+
+bool TagMatch::has(int predicate) const
+{
+  return this->Flags[predicate] != 0;
+}
+
+string_view TagMatch::value(int key) const
+{
+  return this->Values[key];
+}
+
+bool TagMatch::found(int key) const
+{
+  return this->Found[key] != 0;
+}
+
+
+//
+// TagMatcher
+//
+TagMatcher::TagMatcher()
+  : NumValues(0), NumFlags(0)
+{
+}
+
+//
+// findOrAddKey
+//
+// Returns the entry for the given key, adding it if it is new.
+//
+TagMatcher::Key& TagMatcher::findOrAddKey(string_view key)
+{
+  for (Key& K : this->Keys)
+  {
+    if (K.Text == key)
+    {
+      return K;
+    }
+  }
+
+  Key K;
+  K.Text = string(key);
+  K.ValueSlot = -1;
+
+  unsigned char first = key.empty() ? 0 : (unsigned char) key[0];
+  this->ByFirstChar[first].push_back((int) this->Keys.size());
+
+  this->Keys.push_back(K);
+  return this->Keys.back();
+}
+
+int TagMatcher::addKey(string_view key)
+{
+  Key& K = this->findOrAddKey(key);
+
+  if (K.ValueSlot < 0)
+  {
+    K.ValueSlot = this->NumValues++;
+  }
+
+  return K.ValueSlot;
+}
+
+int TagMatcher::addKeyValue(string_view key, string_view value)
+{
+  return this->addKeyValues(key, { value });
+}
+
+int TagMatcher::addKeyValues(string_view key, initializer_list<string_view> values)
+{
+  Key& K = this->findOrAddKey(key);
+
+  Predicate P;
+  for (string_view value : values)
+  {
+    P.Values.push_back(string(value));
+  }
+  P.Flag = this->NumFlags++;
+
+  K.Predicates.push_back(P);
+  return P.Flag;
+}
+
+TagMatch TagMatcher::newMatch() const
+{
+  TagMatch result;
+
+  result.Values.resize(this->NumValues);
+  result.Found.resize(this->NumValues, 0);
+  result.Flags.resize(this->NumFlags, 0);
+
+  return result;
+}
+
+//
+// match
+//
+// Looks the tag's key up among the keys starting with the same
+// character, then records its value and any predicates it satisfies.
+//
+void TagMatcher::match(string_view key, string_view value, TagMatch& result) const
+{
+  unsigned char first = key.empty() ? 0 : (unsigned char) key[0];
+
+  for (int k : this->ByFirstChar[first])
+  {
+    const Key& K = this->Keys[k];
+
+    if (K.Text != key)
+    {
+      continue;
+    }
+
+    if (K.ValueSlot >= 0 && !result.Found[K.ValueSlot])
+    {
+      result.Values[K.ValueSlot] = value;
+      result.Found[K.ValueSlot] = 1;
+    }
+
+    for (const Predicate& P : K.Predicates)
+    {
+      for (const string& V : P.Values)
+      {
+        if (V == value)
+        {
+          result.Flags[P.Flag] = 1;
+          break;
+        }
+      }
+    }
+
+    return;
+  }
+}
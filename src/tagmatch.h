@@ -0,0 +1,147 @@
+/*tagmatch.h*/
+
+//
+// Precompiled matching of Open Street Map tags.
+//
+// osmContainsKeyValue and osmGetKeyValue answer one question per scan
+// of an element's tags, so finding a building's name and address
+// means scanning the same tags four times. A TagMatcher is set up once
+// with every key and (key, value) pair of interest, and then answers
+// all of them in a single pass over the tags. Results are string_views
+// into the caller's tag text, so matching never allocates.
+//
+// Example:
+//
+//   TagMatcher matcher;
+//   int building = matcher.addKeyValue("building", "university");
+//   int name = matcher.addKey("name");
+//
+//   TagMatch match = matcher.newMatch();
+//   for (each tag (k, v) of an element)
+//     matcher.match(k, v, match);
+//
+//   if (match.has(building)) ... match.value(name) ...
+//
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <initializer_list>
+
+using namespace std;
+
+
+//
+// TagMatch
+//
+// Results of matching one element's tags: for each key added with
+// addKey, the value of the first tag with that key; for each predicate
+// added with addKeyValue(s), whether a matching tag was seen. Reuse one
+// TagMatch for many elements by calling reset() in between.
+//
+class TagMatch
+{
+private:
+  vector<string_view> Values;
+  vector<char> Found;  // per key: was a value found?
+  vector<char> Flags;  // per predicate: did it match?
+
+  friend class TagMatcher;
+
+public:
+  //
+  // reset
+  //
+  // Clears all results, ready for the next element.
+  //
+  void reset();
+
+  //
+  // has
+  //
+  // True if the given predicate (from addKeyValue/addKeyValues)
+  // matched a tag.
+  //
+  bool has(int predicate) const;
+
+  //
+  // value
+  //
+  // The value of the first tag with the given key (from addKey),
+  // or "" if there was none. found() tells the two cases apart.
+  //
+  string_view value(int key) const;
+  bool found(int key) const;
+};
+
+
+//
+// TagMatcher
+//
+// A fixed set of keys and (key, value) predicates, compiled into a
+// per-key table so that each tag is looked up once.
+//
+class TagMatcher
+{
+private:
+  struct Predicate
+  {
+    vector<string> Values;  // any of these values matches
+    int Flag;
+  };
+
+  struct Key
+  {
+    string Text;
+    int ValueSlot;  // -1 if the value is not wanted
+    vector<Predicate> Predicates;
+  };
+
+  vector<Key> Keys;
+  int NumValues;
+  int NumFlags;
+
+  //
+  // first-character dispatch: for each byte, the keys starting with it
+  //
+  vector<int> ByFirstChar[256];
+
+  Key& findOrAddKey(string_view key);
+
+public:
+  TagMatcher();
+
+  //
+  // addKey
+  //
+  // Asks for the value of the given key. Returns the key's index for
+  // TagMatch::value / found.
+  //
+  int addKey(string_view key);
+
+  //
+  // addKeyValue / addKeyValues
+  //
+  // Asks whether a tag with the given key and value (or any of the
+  // given values) is present. Returns the predicate's index for
+  // TagMatch::has.
+  //
+  int addKeyValue(string_view key, string_view value);
+  int addKeyValues(string_view key, initializer_list<string_view> values);
+
+  //
+  // newMatch
+  //
+  // Returns an empty TagMatch sized for this matcher.
+  //
+  TagMatch newMatch() const;
+
+  //
+  // match
+  //
+  // Records one tag of the current element in the given match.
+  //
+  void match(string_view key, string_view value, TagMatch& result) const;
+};